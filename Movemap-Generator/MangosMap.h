@@ -47,6 +47,34 @@ namespace MaNGOS
         uint32 holesSize; /**< TODO */
     };
 
+    // packed map files (maps/%03u.pmap), see map-extractor/PackedMapFile.h
+#define MAP_PACKED_MAGIC        "MPAK"
+#define MAP_PACKED_GRID_SIZE    64
+
+    /**
+     * @brief
+     *
+     */
+    struct GridMapPackedHeader
+    {
+        uint32 packMagic; /**< TODO */
+        uint32 versionMagic; /**< TODO */
+        uint32 buildMagic; /**< TODO */
+        uint32 mapId; /**< TODO */
+        uint32 tileCount; /**< TODO */
+        uint32 tileAlignment; /**< TODO */
+    };
+
+    /**
+     * @brief Index entry of a tile in a packed map file, the index is [y][x]
+     *
+     */
+    struct GridMapPackedTile
+    {
+        uint32 offset; /**< TODO */
+        uint32 size; /**< TODO */
+    };
+
     // ==============mmaps don't use area==============
     //#define MAP_AREA_NO_AREA      0x0001
 
@@ -60,6 +88,8 @@ namespace MaNGOS
 #define MAP_HEIGHT_NO_HEIGHT  0x0001
 #define MAP_HEIGHT_AS_INT16   0x0002
 #define MAP_HEIGHT_AS_INT8    0x0004
+#define MAP_HEIGHT_CELL_PACKED 0x0008   // per cell float min[16][16] and max[16][16] precede the int values
+#define MAP_HEIGHT_AS_FLOAT16 0x0010    // half floats relative to (gridHeight + gridMaxHeight) / 2
 
     /**
      * @brief
@@ -75,6 +105,9 @@ namespace MaNGOS
 
 #define MAP_LIQUID_NO_TYPE    0x0001
 #define MAP_LIQUID_NO_HEIGHT  0x0002
+#define MAP_LIQUID_HEIGHT_AS_FLOAT16 0x0004 // half floats relative to liquidLevel
+#define MAP_LIQUID_SPARSE     0x0008    // uint16 cells[16], then per cell with liquid uint64 show bits and 9x9 heights
+#define MAP_LIQUID_HALF_NO_HEIGHT 0xFC00 // half float height of points without liquid
 
     /**
      * @brief
@@ -27,17 +27,56 @@
 
 #include "MMapCommon.h"
 #include "MapBuilder.h"
+#include "MapTileReader.h"
 
 #include "MapTree.h"
 #include "ModelInstance.h"
 #include "ExtractorCommon.h"
 
-#include "TileMsgBlock.h"
-
 using namespace VMAP;
 
 namespace MMAP
 {
+    /**
+     * @brief Builds one tile on a worker of the scheduler
+     *
+     */
+    class TileBuildTask : public Task
+    {
+        public:
+            /**
+             * @brief
+             *
+             * @param builder
+             * @param mapID
+             * @param tileX
+             * @param tileY
+             * @param navMesh own copy of the map's navmesh, freed with the task
+             */
+            TileBuildTask(MapBuilder* builder, int mapID, int tileX, int tileY, dtNavMesh* navMesh) :
+                m_builder(builder), m_mapID(mapID), m_tileX(tileX), m_tileY(tileY), m_navMesh(navMesh)
+            {
+            }
+
+            ~TileBuildTask()
+            {
+                dtFreeNavMesh(m_navMesh);
+            }
+
+            void run()
+            {
+                m_builder->buildTile(m_mapID, m_tileX, m_tileY, m_navMesh);
+            }
+
+        private:
+            MapBuilder* m_builder;  /**< TODO */
+            int m_mapID;            /**< TODO */
+            int m_tileX;            /**< TODO */
+            int m_tileY;            /**< TODO */
+            dtNavMesh* m_navMesh;   /**< TODO */
+    };
+
+    /**************************************************************************/
     MapBuilder::MapBuilder(char const* magic, float maxWalkableAngle, bool skipLiquid,
                            bool skipContinents, bool skipJunkMaps, bool skipBattlegrounds,
                            bool debugOutput, bool bigBaseUnit, const char* offMeshFilePath) :
@@ -51,7 +90,7 @@ namespace MMAP
         m_rcContext(NULL),
         m_offMeshFilePath(offMeshFilePath),
         m_magic(magic),
-        m_numThreads(-1), m_threadPool(NULL), m_poolActivated(false)
+        m_scheduler(NULL), m_tileTasks(NULL)
     {
         m_terrainBuilder = new TerrainBuilder(skipLiquid);
 
@@ -65,8 +104,8 @@ namespace MMAP
     {
         if (activated())
         {
-            delete m_threadPool;
-            m_poolActivated = false;
+            delete m_tileTasks;
+            delete m_scheduler;
         }
         for (TileList::iterator it = m_tiles.begin(); it != m_tiles.end(); ++it)
         {
@@ -81,19 +120,14 @@ namespace MMAP
     /**************************************************************************/
     int MapBuilder::activate(int num_threads)
     {
-        int result = -1;
-        m_numThreads = num_threads;
-        m_threadPool = new TileThreadPool();
-
-        if (m_threadPool && m_numThreads && !m_poolActivated)
+        if (activated() || !num_threads)
         {
-            result = m_threadPool->start(m_numThreads);
-            if (result != -1)
-            {
-                m_poolActivated = true;
-            }
+            return -1;
         }
-        return result;
+
+        m_scheduler = new TaskScheduler(num_threads);
+        m_tileTasks = new TaskGroup(*m_scheduler);
+        return 0;
     }
 
     /**************************************************************************/
@@ -146,13 +180,30 @@ namespace MMAP
                 count++;
             }
 
-            sprintf(filter, "%03u*", mapID);
+            vector<pair<uint32, uint32> > packedTiles;
+            bool packed = MapTileReader::getPackedTiles(mapID, packedTiles);
+            for (uint32 i = 0; i < packedTiles.size(); ++i)
+            {
+                tileID = StaticMapTree::packTileID(packedTiles[i].first, packedTiles[i].second);
+
+                if (tiles->insert(tileID).second)
+                {
+                    count++;
+                }
+            }
+
+            // loose tiles written after the packed file are read instead of it
+            sprintf(filter, "%03u*.map", mapID);
             files.clear();
             getDirContents(files, "maps", filter);
             for (uint32 i = 0; i < files.size(); ++i)
             {
                 tileY = uint32(atoi(files[i].substr(3, 2).c_str()));
                 tileX = uint32(atoi(files[i].substr(5, 2).c_str()));
+                if (packed && !MapTileReader::useLooseTile(mapID, tileX, tileY))
+                {
+                    continue;
+                }
                 tileID = StaticMapTree::packTileID(tileX, tileY);
 
                 if (tiles->insert(tileID).second)
@@ -192,10 +243,7 @@ namespace MMAP
 
         if (activated())
         {
-            Tile_Message_Block *finish_mb = new Tile_Message_Block(NULL);
-            finish_mb->msg_type(ACE_Message_Block::MB_HANGUP);
-            m_threadPool->putq(finish_mb);
-            m_threadPool->wait();
+            m_tileTasks->wait();
         }
 
     }
@@ -268,21 +316,13 @@ namespace MMAP
                 buildNavMesh(mapID, mesh, meshParams); //meshParams is not null, so we get a new pointer to dtNavMesh
                 if (mesh)
                 {
-                    TileBuilder* tb = new TileBuilder(this, mapID, tileX, tileY, mesh);
-                    Tile_Message_Block *mb = new Tile_Message_Block(tb);
-                    if (m_threadPool->putq(mb) == -1)
-                    {
-                        break;
-                    }
+                    m_tileTasks->run(new TileBuildTask(this, mapID, tileX, tileY, mesh));
                 }
             }
         }
         if (activated() && standAlone)
         {
-            Tile_Message_Block *finish_mb = new Tile_Message_Block(NULL);
-            finish_mb->msg_type(ACE_Message_Block::MB_HANGUP);
-            m_threadPool->putq(finish_mb);
-            m_threadPool->wait();
+            m_tileTasks->wait();
         }
 
         if (!activated())
@@ -38,7 +38,7 @@
 #include "IVMapManager.h"
 #include "WorldModel.h"
 
-#include "TileThreadPool.h"
+#include "TaskScheduler.h"
 
 using namespace std;
 using namespace VMAP;
@@ -138,9 +138,20 @@ namespace MMAP
              */
             void buildAllMaps();
 
+            /**
+             * @brief Starts the worker threads tiles are built on
+             *
+             * @param num_threads
+             * @return int -1 if the workers could not be started
+             */
             int activate(int num_threads);
 
-            bool activated() const { return m_poolActivated; }
+            /**
+             * @brief
+             *
+             * @return bool true if tiles are built by the scheduler
+             */
+            bool activated() const { return m_scheduler != NULL; }
 
             /**
              * @brief
@@ -242,9 +253,8 @@ namespace MMAP
             bool m_bigBaseUnit; /**< TODO */
             char const* m_magic;
 
-            int             m_numThreads;
-            TileThreadPool* m_threadPool;
-            bool            m_poolActivated;
+            TaskScheduler* m_scheduler; /**< TODO */
+            TaskGroup* m_tileTasks; /**< tiles scheduled and not yet built */
 
             rcContext* m_rcContext; /**< build performance - not really used for now */
     };
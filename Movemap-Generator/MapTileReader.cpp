@@ -0,0 +1,380 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "MapTileReader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace MMAP
+{
+    /**
+     * @brief A memory mapped packed map file
+     *
+     */
+    class PackedMapFile
+    {
+        public:
+            /**
+             * @brief Maps the file and validates its header and index
+             *
+             * @param filename
+             * @return PackedMapFile NULL if the file is missing or invalid
+             */
+            static PackedMapFile* open(char const* filename)
+            {
+                PackedMapFile* file = new PackedMapFile();
+                if (!file->mapFile(filename) || !file->validate(filename))
+                {
+                    delete file;
+                    return NULL;
+                }
+                return file;
+            }
+
+            ~PackedMapFile()
+            {
+#ifdef WIN32
+                if (m_data)
+                {
+                    UnmapViewOfFile(m_data);
+                }
+                if (m_mapping)
+                {
+                    CloseHandle(m_mapping);
+                }
+                if (m_file != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(m_file);
+                }
+#else
+                if (m_data)
+                {
+                    munmap((void*)m_data, m_size);
+                }
+#endif
+            }
+
+            /**
+             * @brief
+             *
+             * @param tileX
+             * @param tileY
+             * @return const GridMapPackedTile
+             */
+            GridMapPackedTile const& getTile(uint32 tileX, uint32 tileY) const
+            {
+                return m_index[tileY * MAP_PACKED_GRID_SIZE + tileX];
+            }
+
+            /**
+             * @brief
+             *
+             * @return const char
+             */
+            char const* getData() const { return m_data; }
+
+        private:
+            PackedMapFile() : m_data(NULL), m_size(0), m_index(NULL)
+#ifdef WIN32
+                , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+            {
+            }
+
+            bool mapFile(char const* filename)
+            {
+#ifdef WIN32
+                m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (m_file == INVALID_HANDLE_VALUE)
+                {
+                    return false;
+                }
+
+                LARGE_INTEGER size;
+                if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+                {
+                    return false;
+                }
+                m_size = size_t(size.QuadPart);
+
+                m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (!m_mapping)
+                {
+                    return false;
+                }
+
+                m_data = (char const*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+                return m_data != NULL;
+#else
+                int fd = ::open(filename, O_RDONLY);
+                if (fd < 0)
+                {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size == 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                m_size = size_t(st.st_size);
+
+                void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (data == MAP_FAILED)
+                {
+                    return false;
+                }
+
+                m_data = (char const*)data;
+                return true;
+#endif
+            }
+
+            bool validate(char const* filename)
+            {
+                size_t indexEnd = sizeof(GridMapPackedHeader) + sizeof(GridMapPackedTile) * MAP_PACKED_GRID_SIZE * MAP_PACKED_GRID_SIZE;
+                GridMapPackedHeader const* header = (GridMapPackedHeader const*)m_data;
+                if (m_size < indexEnd || header->packMagic != *(uint32 const*)MAP_PACKED_MAGIC)
+                {
+                    printf("%s is not a valid packed map file\n", filename);
+                    return false;
+                }
+
+                m_index = (GridMapPackedTile const*)(m_data + sizeof(GridMapPackedHeader));
+                for (int i = 0; i < MAP_PACKED_GRID_SIZE * MAP_PACKED_GRID_SIZE; ++i)
+                {
+                    if (m_index[i].size && (m_index[i].offset < indexEnd || size_t(m_index[i].offset) + m_index[i].size > m_size))
+                    {
+                        printf("%s is truncated, please extract new .map files\n", filename);
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            char const* m_data;                 /**< TODO */
+            size_t m_size;                      /**< TODO */
+            GridMapPackedTile const* m_index;   /**< TODO */
+#ifdef WIN32
+            HANDLE m_file;                      /**< TODO */
+            HANDLE m_mapping;                   /**< TODO */
+#endif
+    };
+
+    /**
+     * @brief Packed map files opened so far, NULL for maps without one.
+     *        Shared by all builder threads, the files stay mapped until exit.
+     *
+     */
+    class PackedMapCache
+    {
+        public:
+            ~PackedMapCache()
+            {
+                for (map<uint32, PackedMapFile*>::iterator itr = m_files.begin(); itr != m_files.end(); ++itr)
+                {
+                    delete itr->second;
+                }
+            }
+
+            PackedMapFile const* get(uint32 mapID)
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                map<uint32, PackedMapFile*>::iterator itr = m_files.find(mapID);
+                if (itr != m_files.end())
+                {
+                    return itr->second;
+                }
+
+                char fileName[255];
+                sprintf(fileName, "maps/%03u.pmap", mapID);
+                PackedMapFile* file = PackedMapFile::open(fileName);
+                m_files[mapID] = file;
+                return file;
+            }
+
+        private:
+            std::mutex m_lock;                      /**< TODO */
+            map<uint32, PackedMapFile*> m_files;    /**< TODO */
+    };
+
+    static PackedMapCache packedMaps; /**< TODO */
+
+    /**************************************************************************/
+    MapTileReader::MapTileReader() : m_data(NULL), m_size(0), m_pos(0)
+    {
+        m_name[0] = '\0';
+    }
+
+    /**************************************************************************/
+    MapTileReader::~MapTileReader()
+    {
+        close();
+    }
+
+    /**************************************************************************/
+    bool MapTileReader::open(uint32 mapID, uint32 tileX, uint32 tileY)
+    {
+        close();
+
+        if (tileX >= MAP_PACKED_GRID_SIZE || tileY >= MAP_PACKED_GRID_SIZE)
+        {
+            return false;
+        }
+
+        PackedMapFile const* packed = packedMaps.get(mapID);
+        if (packed && !useLooseTile(mapID, tileX, tileY))
+        {
+            GridMapPackedTile const& tile = packed->getTile(tileX, tileY);
+            if (!tile.size)
+            {
+                return false;
+            }
+
+            sprintf(m_name, "maps/%03u.pmap tile %02u,%02u", mapID, tileY, tileX);
+            m_data = packed->getData() + tile.offset;
+            m_size = tile.size;
+            return true;
+        }
+
+        sprintf(m_name, "maps/%03u%02u%02u.map", mapID, tileY, tileX);
+        FILE* mapFile = fopen(m_name, "rb");
+        if (!mapFile)
+        {
+            return false;
+        }
+
+        fseek(mapFile, 0, SEEK_END);
+        long size = ftell(mapFile);
+        fseek(mapFile, 0, SEEK_SET);
+        if (size > 0)
+        {
+            m_buffer.resize(size);
+            m_buffer.resize(fread(&m_buffer[0], 1, size, mapFile));
+        }
+        fclose(mapFile);
+
+        m_data = m_buffer.empty() ? NULL : &m_buffer[0];
+        m_size = m_buffer.size();
+        return true;
+    }
+
+    /**************************************************************************/
+    void MapTileReader::close()
+    {
+        m_data = NULL;
+        m_size = 0;
+        m_pos = 0;
+        m_buffer.clear();
+    }
+
+    /**************************************************************************/
+    size_t MapTileReader::read(void* buffer, size_t size, size_t count)
+    {
+        if (!size || m_pos >= m_size)
+        {
+            return 0;
+        }
+
+        size_t items = (m_size - m_pos) / size;
+        if (items > count)
+        {
+            items = count;
+        }
+
+        memcpy(buffer, m_data + m_pos, items * size);
+        m_pos += items * size;
+        return items;
+    }
+
+    /**************************************************************************/
+    bool MapTileReader::seek(uint32 offset)
+    {
+        if (offset > m_size)
+        {
+            // like fseek past the end, the following reads hit the end of the tile
+            m_pos = m_size;
+            return false;
+        }
+
+        m_pos = offset;
+        return true;
+    }
+
+    /**************************************************************************/
+    bool MapTileReader::useLooseTile(uint32 mapID, uint32 tileX, uint32 tileY)
+    {
+        char looseName[255];
+        sprintf(looseName, "maps/%03u%02u%02u.map", mapID, tileY, tileX);
+        struct stat looseStat;
+        if (stat(looseName, &looseStat) != 0)
+        {
+            return false;
+        }
+
+        // written by a later run of the extractor without --packed, which
+        // does not touch the packed file, e.g. a --tile repair
+        char packedName[255];
+        sprintf(packedName, "maps/%03u.pmap", mapID);
+        struct stat packedStat;
+        return stat(packedName, &packedStat) != 0 || looseStat.st_mtime >= packedStat.st_mtime;
+    }
+
+    /**************************************************************************/
+    bool MapTileReader::getPackedTiles(uint32 mapID, vector<pair<uint32, uint32> >& tiles)
+    {
+        PackedMapFile const* packed = packedMaps.get(mapID);
+        if (!packed)
+        {
+            return false;
+        }
+
+        for (uint32 tileY = 0; tileY < MAP_PACKED_GRID_SIZE; ++tileY)
+        {
+            for (uint32 tileX = 0; tileX < MAP_PACKED_GRID_SIZE; ++tileX)
+            {
+                if (packed->getTile(tileX, tileY).size)
+                {
+                    tiles.push_back(pair<uint32, uint32>(tileX, tileY));
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef MANGOS_H_MMAP_MAP_TILE_READER
+#define MANGOS_H_MMAP_MAP_TILE_READER
+
+#include "MMapCommon.h"
+#include "MangosMap.h"
+
+using namespace MaNGOS;
+
+namespace MMAP
+{
+    /**
+     * @brief Read access to the .map data of a single tile
+     *
+     * The tile is taken from the packed map file maps/%03u.pmap when there is
+     * one, which is memory mapped once and shared by all readers. Otherwise,
+     * or when the loose maps/%03u%02u%02u.map file of the tile is not older
+     * than the packed file, the loose file is read. The interface mirrors
+     * fread/fseek so the map loading code works the same for both.
+     */
+    class MapTileReader
+    {
+        public:
+            /**
+             * @brief
+             *
+             */
+            MapTileReader();
+            /**
+             * @brief
+             *
+             */
+            ~MapTileReader();
+
+            /**
+             * @brief
+             *
+             * @param mapID
+             * @param tileX
+             * @param tileY
+             * @return bool false if the tile does not exist
+             */
+            bool open(uint32 mapID, uint32 tileX, uint32 tileY);
+            /**
+             * @brief
+             *
+             */
+            void close();
+
+            /**
+             * @brief Reads up to count items of size bytes, like fread
+             *
+             * @param buffer
+             * @param size
+             * @param count
+             * @return size_t number of complete items read
+             */
+            size_t read(void* buffer, size_t size, size_t count);
+            /**
+             * @brief Moves to an offset from the start of the tile
+             *
+             * @param offset
+             * @return bool false if the offset is past the end, the position
+             *         is then moved to the end so further reads fail
+             */
+            bool seek(uint32 offset);
+
+            /**
+             * @brief Name of the tile for messages
+             *
+             * @return const char
+             */
+            char const* getName() const { return m_name; }
+
+            /**
+             * @brief Collects the tiles stored in the packed map file of a map
+             *
+             * @param mapID
+             * @param tiles receives (tileX, tileY) pairs
+             * @return bool false if the map has no packed map file
+             */
+            static bool getPackedTiles(uint32 mapID, vector<pair<uint32, uint32> >& tiles);
+
+            /**
+             * @brief Whether the loose file of a tile is read instead of the
+             *        packed map file
+             *
+             * @param mapID
+             * @param tileX
+             * @param tileY
+             * @return bool true if the loose file exists and is not older than
+             *         the packed file of its map, or the map has none
+             */
+            static bool useLooseTile(uint32 mapID, uint32 tileX, uint32 tileY);
+
+        private:
+            MapTileReader(MapTileReader const&);
+            MapTileReader& operator=(MapTileReader const&);
+
+            char m_name[255];           /**< TODO */
+            char const* m_data;         /**< TODO */
+            size_t m_size;              /**< TODO */
+            size_t m_pos;               /**< TODO */
+            vector<char> m_buffer;      /**< contents of a loose .map file */
+    };
+}
+
+#endif
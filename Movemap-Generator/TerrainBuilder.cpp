@@ -26,6 +26,7 @@
 
 #include "MMapCommon.h"
 #include "MapBuilder.h"
+#include "MapTileReader.h"
 
 #include "VMapManager2.h"
 #include "MapTree.h"
@@ -70,6 +71,184 @@ namespace MMAP
         }
     }
 
+    /**
+     * @brief Cell of a V8/V9 row or column, V9 points on a cell border belong
+     *        to the higher cell, row or column 8 * k to cell k, and the last
+     *        V9 row and column to the last cell (see map-extractor ConvertADT)
+     *
+     * @param pos
+     * @return int
+     */
+    static inline int getHeightCell(int pos)
+    {
+        int cell = pos / 8;
+        return cell < 16 ? cell : 15;
+    }
+
+    /**
+     * @brief Unpacks a MAP_HEIGHT_CELL_PACKED height grid
+     *
+     * @param packed
+     * @param heights
+     * @param size width and height of the grid
+     * @param cellMin
+     * @param cellMax
+     * @param maxValue largest packed value, 255 or 65535
+     */
+    template<class T>
+    static void unpackCellHeights(T const* packed, float* heights, int size, float const cellMin[16][16], float const cellMax[16][16], float maxValue)
+    {
+        for (int i = 0; i < size * size; ++i)
+        {
+            int cy = getHeightCell(i / size);
+            int cx = getHeightCell(i % size);
+            float heightMultiplier = (cellMax[cy][cx] - cellMin[cy][cx]) / maxValue;
+            heights[i] = (float)packed[i] * heightMultiplier + cellMin[cy][cx];
+        }
+    }
+
+    /**
+     * @brief Expands a half float height stored relative to base
+     *
+     * @param value
+     * @param base
+     * @return float
+     */
+    static float halfToHeight(uint16 value, float base)
+    {
+        uint32 sign = uint32(value & 0x8000) << 16;
+        uint32 exponent = (value >> 10) & 0x1F;
+        uint32 mantissa = value & 0x3FF;
+
+        float result;
+        if (exponent == 0)
+        {
+            // zero or subnormal
+            result = float(mantissa) * 5.9604644775390625e-8f;
+            result = sign ? -result : result;
+        }
+        else
+        {
+            uint32 bits = sign | (exponent == 0x1F ? 0x7F800000 : (exponent + 112) << 23) | (mantissa << 13);
+            memcpy(&result, &bits, sizeof(result));
+        }
+        return result + base;
+    }
+
+    /**
+     * @brief Expands a half float liquid height, points without liquid come
+     *        back as exactly INVALID_MAP_LIQ_HEIGHT like in float tiles
+     *
+     * @param value
+     * @param liquidLevel
+     * @return float
+     */
+    static float halfToLiquidHeight(uint16 value, float liquidLevel)
+    {
+        if (value == MAP_LIQUID_HALF_NO_HEIGHT)
+        {
+            return INVALID_MAP_LIQ_HEIGHT;
+        }
+        return halfToHeight(value, liquidLevel);
+    }
+
+    /**
+     * @brief Reads MAP_LIQUID_SPARSE liquid into a V9 sized height map
+     *
+     * Only the cells listed in the cell table are stored and only their
+     * points are filled in, the mesh gets vertices and triangles for those
+     * cells alone (see isLiquidCellPoint).
+     *
+     * @param mapFile positioned after the liquid types
+     * @param lheader
+     * @param cells receives the cell table, bit x of row y set for cells with liquid
+     * @param liquid_map receives V9_SIZE_SQ heights, allocated with new[]
+     * @return bool
+     */
+    static bool loadSparseLiquid(MapTileReader& mapFile, GridMapLiquidHeader const& lheader, uint16 cells[16], float*& liquid_map)
+    {
+        if (mapFile.read(cells, sizeof(uint16) * 16, 1) != 1)
+        {
+            return false;
+        }
+
+        liquid_map = new float [V9_SIZE_SQ];
+        for (int i = 0; i < V9_SIZE_SQ; ++i)
+        {
+            liquid_map[i] = INVALID_MAP_LIQ_HEIGHT;
+        }
+
+        bool asHalf = (lheader.flags & MAP_LIQUID_HEIGHT_AS_FLOAT16) != 0;
+        for (int cy = 0; cy < 16; ++cy)
+        {
+            for (int cx = 0; cx < 16; ++cx)
+            {
+                if (!(cells[cy] & (1 << cx)))
+                {
+                    continue;
+                }
+
+                // the liquid_show bits are not needed, shown points have valid heights
+                uint64 show;
+                if (mapFile.read(&show, sizeof(show), 1) != 1)
+                {
+                    return false;
+                }
+
+                float heights[9 * 9];
+                if (asHalf)
+                {
+                    uint16 halfHeights[9 * 9];
+                    if (mapFile.read(halfHeights, sizeof(halfHeights), 1) != 1)
+                    {
+                        return false;
+                    }
+                    for (int k = 0; k < 9 * 9; ++k)
+                    {
+                        heights[k] = halfToLiquidHeight(halfHeights[k], lheader.liquidLevel);
+                    }
+                }
+                else if (mapFile.read(heights, sizeof(heights), 1) != 1)
+                {
+                    return false;
+                }
+
+                for (int y = 0; y < 9; ++y)
+                {
+                    for (int x = 0; x < 9; ++x)
+                    {
+                        liquid_map[(cy * 8 + y) * V9_SIZE + cx * 8 + x] = heights[y * 9 + x];
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether a V9 point is a corner of a MAP_LIQUID_SPARSE cell with
+     *        liquid, points on a cell border belong to both cells
+     *
+     * @param cells
+     * @param row
+     * @param col
+     * @return bool
+     */
+    static bool isLiquidCellPoint(uint16 const cells[16], int row, int col)
+    {
+        for (int cy = (row - 1) / 8; cy <= row / 8 && cy < 16; ++cy)
+        {
+            for (int cx = (col - 1) / 8; cx <= col / 8 && cx < 16; ++cx)
+            {
+                if (cells[cy] & (1 << cx))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
     /**************************************************************************/
     void TerrainBuilder::loadMap(uint32 mapID, uint32 tileX, uint32 tileY, MeshData& meshData,char const* MAP_VERSION_MAGIC)
     {
@@ -85,39 +264,37 @@ namespace MMAP
     /**************************************************************************/
     bool TerrainBuilder::loadMap(uint32 mapID, uint32 tileX, uint32 tileY, MeshData& meshData, Spot portion,char const* MAP_VERSION_MAGIC)
     {
-        char mapFileName[255];
-        sprintf(mapFileName, "maps/%03u%02u%02u.map", mapID, tileY, tileX);
-
-        FILE* mapFile = fopen(mapFileName, "rb");
-        if (!mapFile)
+        MapTileReader mapFile;
+        if (!mapFile.open(mapID, tileX, tileY))
         {
             return false;
         }
+        char const* mapFileName = mapFile.getName();
 
         GridMapFileHeader fheader;
-        size_t file_read = fread(&fheader, sizeof(GridMapFileHeader), 1, mapFile);
+        size_t file_read = mapFile.read(&fheader, sizeof(GridMapFileHeader), 1);
 
         if (file_read <= 0)
         {
-            fclose(mapFile);
+            mapFile.close();
             printf("Could not read map data from %s.\n", mapFileName);
             return false;
         }
 
         if (fheader.versionMagic != *((uint32 const*)(MAP_VERSION_MAGIC)))
         {
-            fclose(mapFile);
+            mapFile.close();
             printf("%s is the wrong version, please extract new .map files\n", mapFileName);
             return false;
         }
 
         GridMapHeightHeader hheader;
-        fseek(mapFile, fheader.heightMapOffset, SEEK_SET);
-        file_read = fread(&hheader, sizeof(GridMapHeightHeader), 1, mapFile);
+        mapFile.seek(fheader.heightMapOffset);
+        file_read = mapFile.read(&hheader, sizeof(GridMapHeightHeader), 1);
 
         if (file_read <= 0)
         {
-            fclose(mapFile);
+            mapFile.close();
             printf("Could not read map data from %s.\n", mapFileName);
             return false;
         }
@@ -128,7 +305,7 @@ namespace MMAP
         // no data in this map file
         if (!haveTerrain && !haveLiquid)
         {
-            fclose(mapFile);
+            mapFile.close();
             return false;
         }
 
@@ -147,79 +324,137 @@ namespace MMAP
             float heightMultiplier;
             float V9[V9_SIZE_SQ], V8[V8_SIZE_SQ];
 
+            float cellMin[16][16], cellMax[16][16];
+            bool cellPacked = (hheader.flags & MAP_HEIGHT_CELL_PACKED) != 0;
+            if (cellPacked)
+            {
+                if (mapFile.read(cellMin, sizeof(cellMin), 1) != 1 || mapFile.read(cellMax, sizeof(cellMax), 1) != 1)
+                {
+                    mapFile.close();
+                    printf("Could not read map data from %s.\n", mapFileName);
+                    return false;
+                }
+            }
+
             if (hheader.flags & MAP_HEIGHT_AS_INT8)
             {
                 uint8 v9[V9_SIZE_SQ];
                 uint8 v8[V8_SIZE_SQ];
-                file_read = fread(v9, sizeof(uint8), V9_SIZE_SQ, mapFile);
+                file_read = mapFile.read(v9, sizeof(uint8), V9_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
-                file_read = fread(v8, sizeof(uint8), V8_SIZE_SQ, mapFile);
+                file_read = mapFile.read(v8, sizeof(uint8), V8_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
-                heightMultiplier = (hheader.gridMaxHeight - hheader.gridHeight) / 255;
-
-                for (i = 0; i < V9_SIZE_SQ; ++i)
+                if (cellPacked)
                 {
-                    V9[i] = (float)v9[i] * heightMultiplier + hheader.gridHeight;
+                    unpackCellHeights(v9, V9, V9_SIZE, cellMin, cellMax, 255.0f);
+                    unpackCellHeights(v8, V8, V8_SIZE, cellMin, cellMax, 255.0f);
                 }
-
-                for (i = 0; i < V8_SIZE_SQ; ++i)
+                else
                 {
-                    V8[i] = (float)v8[i] * heightMultiplier + hheader.gridHeight;
+                    heightMultiplier = (hheader.gridMaxHeight - hheader.gridHeight) / 255;
+
+                    for (i = 0; i < V9_SIZE_SQ; ++i)
+                    {
+                        V9[i] = (float)v9[i] * heightMultiplier + hheader.gridHeight;
+                    }
+
+                    for (i = 0; i < V8_SIZE_SQ; ++i)
+                    {
+                        V8[i] = (float)v8[i] * heightMultiplier + hheader.gridHeight;
+                    }
                 }
             }
             else if (hheader.flags & MAP_HEIGHT_AS_INT16)
             {
                 uint16 v9[V9_SIZE_SQ];
                 uint16 v8[V8_SIZE_SQ];
-                file_read = fread(v9, sizeof(uint16), V9_SIZE_SQ, mapFile);
+                file_read = mapFile.read(v9, sizeof(uint16), V9_SIZE_SQ);
+                if (file_read <= 0)
+                {
+                    mapFile.close();
+                    printf("Could not read map data from %s.\n", mapFileName);
+                    return false;
+                }
+                file_read = mapFile.read(v8, sizeof(uint16), V8_SIZE_SQ);
+                if (file_read <= 0)
+                {
+                    mapFile.close();
+                    printf("Could not read map data from %s.\n", mapFileName);
+                    return false;
+                }
+                if (cellPacked)
+                {
+                    unpackCellHeights(v9, V9, V9_SIZE, cellMin, cellMax, 65535.0f);
+                    unpackCellHeights(v8, V8, V8_SIZE, cellMin, cellMax, 65535.0f);
+                }
+                else
+                {
+                    heightMultiplier = (hheader.gridMaxHeight - hheader.gridHeight) / 65535;
+
+                    for (i = 0; i < V9_SIZE_SQ; ++i)
+                    {
+                        V9[i] = (float)v9[i] * heightMultiplier + hheader.gridHeight;
+                    }
+
+                    for (i = 0; i < V8_SIZE_SQ; ++i)
+                    {
+                        V8[i] = (float)v8[i] * heightMultiplier + hheader.gridHeight;
+                    }
+                }
+            }
+            else if (hheader.flags & MAP_HEIGHT_AS_FLOAT16)
+            {
+                uint16 v9[V9_SIZE_SQ];
+                uint16 v8[V8_SIZE_SQ];
+                file_read = mapFile.read(v9, sizeof(uint16), V9_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
-                file_read = fread(v8, sizeof(uint16), V8_SIZE_SQ, mapFile);
+                file_read = mapFile.read(v8, sizeof(uint16), V8_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
-                heightMultiplier = (hheader.gridMaxHeight - hheader.gridHeight) / 65535;
 
+                float base = (hheader.gridHeight + hheader.gridMaxHeight) * 0.5f;
                 for (i = 0; i < V9_SIZE_SQ; ++i)
                 {
-                    V9[i] = (float)v9[i] * heightMultiplier + hheader.gridHeight;
+                    V9[i] = halfToHeight(v9[i], base);
                 }
 
                 for (i = 0; i < V8_SIZE_SQ; ++i)
                 {
-                    V8[i] = (float)v8[i] * heightMultiplier + hheader.gridHeight;
+                    V8[i] = halfToHeight(v8[i], base);
                 }
             }
             else
             {
-                file_read = fread(V9, sizeof(float), V9_SIZE_SQ, mapFile);
+                file_read = mapFile.read(V9, sizeof(float), V9_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
-                file_read = fread(V8, sizeof(float), V8_SIZE_SQ, mapFile);
+                file_read = mapFile.read(V8, sizeof(float), V8_SIZE_SQ);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
@@ -227,11 +462,11 @@ namespace MMAP
 
             // hole data
             memset(holes, 0, fheader.holesSize);
-            fseek(mapFile, fheader.holesOffset, SEEK_SET);
-            file_read = fread(holes, fheader.holesSize, 1, mapFile);
+            mapFile.seek(fheader.holesOffset);
+            file_read = mapFile.read(holes, fheader.holesSize, 1);
             if (file_read <= 0)
             {
-                fclose(mapFile);
+                mapFile.close();
                 printf("Could not read map data from %s.\n", mapFileName);
                 return false;
             }
@@ -274,35 +509,71 @@ namespace MMAP
         if (haveLiquid)
         {
             GridMapLiquidHeader lheader;
-            fseek(mapFile, fheader.liquidMapOffset, SEEK_SET);
-            file_read = fread(&lheader, sizeof(GridMapLiquidHeader), 1, mapFile);
+            mapFile.seek(fheader.liquidMapOffset);
+            file_read = mapFile.read(&lheader, sizeof(GridMapLiquidHeader), 1);
             if (file_read <= 0)
             {
-                fclose(mapFile);
+                mapFile.close();
                 printf("Could not read map data from %s.\n", mapFileName);
                 return false;
             }
 
             float* liquid_map = NULL;
+            uint16 liquid_cells[16];        // MAP_LIQUID_SPARSE cells with liquid
+            vector<int> liquidVertIndex;    // MAP_LIQUID_SPARSE vertex of each V9 point, -1 for none
 
             if (!(lheader.flags & MAP_LIQUID_NO_TYPE))
             {
-                file_read = fread(liquid_type, sizeof(liquid_type), 1, mapFile);
+                // the liquid entries come first, the MAP_LIQUID_TYPE_* flags follow
+                uint16 liquid_entry[16][16];
+                file_read = mapFile.read(liquid_entry, sizeof(liquid_entry), 1);
+                if (file_read > 0)
+                {
+                    file_read = mapFile.read(liquid_type, sizeof(liquid_type), 1);
+                }
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
+                    printf("Could not read map data from %s.\n", mapFileName);
+                    return false;
+                }
+            }
+
+            if (lheader.flags & MAP_LIQUID_SPARSE)
+            {
+                if (!loadSparseLiquid(mapFile, lheader, liquid_cells, liquid_map))
+                {
+                    mapFile.close();
+                    delete [] liquid_map;
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
                 }
             }
+            else if (lheader.flags & MAP_LIQUID_HEIGHT_AS_FLOAT16)
+            {
+                int count = lheader.width * lheader.height;
+                vector<uint16> halfHeights(count);
+                file_read = mapFile.read(&halfHeights[0], sizeof(uint16), count);
+                if (file_read <= 0)
+                {
+                    mapFile.close();
+                    printf("Could not read map data from %s.\n", mapFileName);
+                    return false;
+                }
 
-            if (!(lheader.flags & MAP_LIQUID_NO_HEIGHT))
+                liquid_map = new float [count];
+                for (int k = 0; k < count; ++k)
+                {
+                    liquid_map[k] = halfToLiquidHeight(halfHeights[k], lheader.liquidLevel);
+                }
+            }
+            else if (!(lheader.flags & MAP_LIQUID_NO_HEIGHT))
             {
                 liquid_map = new float [lheader.width * lheader.height];
-                file_read = fread(liquid_map, sizeof(float), lheader.width * lheader.height, mapFile);
+                file_read = mapFile.read(liquid_map, sizeof(float), lheader.width * lheader.height);
                 if (file_read <= 0)
                 {
-                    fclose(mapFile);
+                    mapFile.close();
                     delete [] liquid_map;
                     printf("Could not read map data from %s.\n", mapFileName);
                     return false;
@@ -319,7 +590,26 @@ namespace MMAP
                 int row, col;
 
                 // generate coordinates
-                if (!(lheader.flags & MAP_LIQUID_NO_HEIGHT))
+                if (lheader.flags & MAP_LIQUID_SPARSE)
+                {
+                    // only the corners of cells with liquid become vertices
+                    liquidVertIndex.assign(V9_SIZE_SQ, -1);
+                    int emitted = 0;
+                    for (int i = 0; i < V9_SIZE_SQ; ++i)
+                    {
+                        if (!isLiquidCellPoint(liquid_cells, i / V9_SIZE, i % V9_SIZE))
+                        {
+                            continue;
+                        }
+
+                        liquidVertIndex[i] = emitted++;
+                        getLiquidCoord(i, i, xoffset, yoffset, coord, liquid_map);
+                        meshData.liquidVerts.append(coord[0]);
+                        meshData.liquidVerts.append(coord[2]);
+                        meshData.liquidVerts.append(coord[1]);
+                    }
+                }
+                else if (!(lheader.flags & MAP_LIQUID_NO_HEIGHT))
                 {
                     int j = 0;
                     for (int i = 0; i < V9_SIZE_SQ; ++i)
@@ -363,6 +653,23 @@ namespace MMAP
                     for (int j = TOP; j <= BOTTOM; j += triInc)
                     {
                         getHeightTriangle(i, Spot(j), indices, true);
+                        if (lheader.flags & MAP_LIQUID_SPARSE)
+                        {
+                            // the triangles stay in step with the squares, a square
+                            // of a cell without liquid gets an empty one
+                            int cy = i / V8_SIZE / 8;
+                            int cx = i % V8_SIZE / 8;
+                            if (!(liquid_cells[cy] & (1 << cx)))
+                            {
+                                ltriangles.append(-1, -1, -1);
+                                continue;
+                            }
+
+                            for (int k = 0; k < 3; ++k)
+                            {
+                                indices[k] = liquidVertIndex[indices[k]];
+                            }
+                        }
                         ltriangles.append(indices[2] + count);
                         ltriangles.append(indices[1] + count);
                         ltriangles.append(indices[0] + count);
@@ -370,7 +677,7 @@ namespace MMAP
             }
         }
 
-        fclose(mapFile);
+        mapFile.close();
 
         // now that we have gathered the data, we can figure out which parts to keep:
         // liquid above ground, ground above liquid
@@ -439,6 +746,12 @@ namespace MMAP
                     }
                 }
 
+                // squares of cells a sparse tile has no liquid for
+                if (useLiquid && ltris[0] < 0)
+                {
+                    useLiquid = false;
+                }
+
                 // if there is no terrain, don't use terrain
                 if (!ttriangles.size())
                 {
@@ -22,7 +22,7 @@
  * and lore are copyrighted by Blizzard Entertainment, Inc.
  */
 
-#include "ace/High_Res_Timer.h"
+#include <chrono>
 #include "MMapCommon.h"
 #include "MapBuilder.h"
 #include "ExtractorCommon.h"
@@ -403,10 +403,7 @@ int main(int argc, char** argv)
     MapBuilder builder(map_magic, maxAngle, skipLiquid, skipContinents, skipJunkMaps,
                        skipBattlegrounds, debugOutput, bigBaseUnit, offMeshInputPath);
 
-    ACE_Time_Value elapsed;
-    ACE_High_Res_Timer timer;
-
-    timer.start();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     if (tileX > -1 && tileY > -1 && mapnum >= 0)
     {
         builder.buildSingleTile(mapnum, tileX, tileY);
@@ -435,9 +432,8 @@ int main(int argc, char** argv)
             builder.buildAllMaps();
         }
     }
-    timer.stop();
-    timer.elapsed_time(elapsed);
-    printf(" \n Total build time: %ld seconds\n\n", elapsed.sec());
+    long elapsed = long(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start).count());
+    printf(" \n Total build time: %ld seconds\n\n", elapsed);
 
     return silent ? 1 : finish(" Movemap build is complete! Press enter to exit\n", 1);
 }
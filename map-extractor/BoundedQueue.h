@@ -0,0 +1,163 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * @brief Blocking FIFO with a fixed capacity, used between the stages of the
+ *        map conversion pipeline.
+ *
+ * The time producers spend waiting for free space and consumers spend waiting
+ * for items is accumulated, so stalls of each stage can be reported.
+ */
+template<class T>
+class BoundedQueue
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param capacity maximum number of queued items
+         */
+        BoundedQueue(size_t capacity) :
+            m_capacity(capacity ? capacity : 1), m_closed(false), m_pushWait(0), m_popWait(0)
+        {
+        }
+
+        /**
+         * @brief Queue an item, blocks while the queue is full
+         *
+         * @param item
+         * @return bool false if the queue has been closed
+         */
+        bool push(T const& item)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_items.size() >= m_capacity && !m_closed)
+            {
+                Clock::time_point start = Clock::now();
+                while (m_items.size() >= m_capacity && !m_closed)
+                {
+                    m_notFull.wait(lock);
+                }
+                m_pushWait += Clock::now() - start;
+            }
+
+            if (m_closed)
+            {
+                return false;
+            }
+
+            m_items.push_back(item);
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Take the oldest item, blocks while the queue is empty
+         *
+         * @param item
+         * @return bool false once the queue is closed and drained
+         */
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_items.empty() && !m_closed)
+            {
+                Clock::time_point start = Clock::now();
+                while (m_items.empty() && !m_closed)
+                {
+                    m_notEmpty.wait(lock);
+                }
+                m_popWait += Clock::now() - start;
+            }
+
+            if (m_items.empty())
+            {
+                return false;
+            }
+
+            item = m_items.front();
+            m_items.pop_front();
+            m_notFull.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief No more items will be pushed, wakes up all waiting threads
+         *
+         */
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_notEmpty.notify_all();
+            m_notFull.notify_all();
+        }
+
+        /**
+         * @brief Total time producers were blocked on a full queue, in seconds
+         *
+         * @return double
+         */
+        double pushWaitSeconds() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::chrono::duration<double>(m_pushWait).count();
+        }
+
+        /**
+         * @brief Total time consumers were blocked on an empty queue, in seconds
+         *
+         * @return double
+         */
+        double popWaitSeconds() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::chrono::duration<double>(m_popWait).count();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        BoundedQueue(BoundedQueue const&);
+        BoundedQueue& operator=(BoundedQueue const&);
+
+        size_t m_capacity; /**< TODO */
+        bool m_closed; /**< TODO */
+        std::deque<T> m_items; /**< TODO */
+        mutable std::mutex m_mutex; /**< TODO */
+        std::condition_variable m_notEmpty; /**< TODO */
+        std::condition_variable m_notFull; /**< TODO */
+        Clock::duration m_pushWait; /**< TODO */
+        Clock::duration m_popWait; /**< TODO */
+};
+
+#endif
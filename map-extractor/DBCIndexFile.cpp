@@ -0,0 +1,138 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "DBCIndexFile.h"
+#include "ExtractorCommon.h"
+
+#include <string.h>
+#include <algorithm>
+
+/**
+ * @brief Rounds an offset up to the section alignment
+ *
+ * @param offset
+ * @return uint32
+ */
+static uint32 AlignIndexOffset(uint32 offset)
+{
+    return (offset + DBC_INDEX_ALIGNMENT - 1) & ~uint32(DBC_INDEX_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Orders by id, rows of the same id keep their order
+ *
+ * @param a
+ * @param b
+ * @return bool
+ */
+static bool CompareIndexEntry(dbc_indexEntry const& a, dbc_indexEntry const& b)
+{
+    return a.id < b.id;
+}
+
+bool BuildDBCIndex(char const* data, size_t size, std::vector<char>& index)
+{
+    // WDBC, record count, field count, record size, string block size
+    uint32 const dbcHeaderSize = 5 * sizeof(uint32);
+    if (size < dbcHeaderSize || memcmp(data, "WDBC", 4) != 0)
+    {
+        return false;
+    }
+
+    uint32 const* fields = (uint32 const*)data;
+    uint32 recordCount = fields[1];
+    uint32 recordSize = fields[3];
+    uint32 stringSize = fields[4];
+    if (recordSize < sizeof(uint32) || uint64(dbcHeaderSize) + uint64(recordSize) * recordCount + stringSize != size)
+    {
+        return false;
+    }
+
+    char const* records = data + dbcHeaderSize;
+    char const* strings = records + size_t(recordSize) * recordCount;
+
+    std::vector<dbc_indexEntry> entries(recordCount);
+    for (uint32 row = 0; row < recordCount; ++row)
+    {
+        entries[row].id = *(uint32 const*)(records + size_t(row) * recordSize);
+        entries[row].row = row;
+    }
+    std::stable_sort(entries.begin(), entries.end(), CompareIndexEntry);
+
+    // keep the last row of each id
+    size_t unique = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (unique && entries[unique - 1].id == entries[i].id)
+        {
+            entries[unique - 1] = entries[i];
+        }
+        else
+        {
+            entries[unique++] = entries[i];
+        }
+    }
+    entries.resize(unique);
+
+    std::vector<uint32> stringOffsets;
+    for (uint32 offset = 0; offset < stringSize;)
+    {
+        stringOffsets.push_back(offset);
+        char const* end = (char const*)memchr(strings + offset, 0, stringSize - offset);
+        if (!end)
+        {
+            break;
+        }
+        offset = uint32(end - strings) + 1;
+    }
+
+    dbc_indexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.indexMagic = *(uint32 const*)DBC_INDEX_MAGIC;
+    header.indexVersion = DBC_INDEX_VERSION;
+    header.dbcHash = hashBytes(data, size);
+    header.dbcSize = uint32(size);
+    header.recordCount = recordCount;
+    header.recordSize = recordSize;
+    header.recordsOffset = dbcHeaderSize;
+    header.stringBlockOffset = uint32(strings - data);
+    header.stringBlockSize = stringSize;
+    header.maxId = entries.empty() ? 0 : entries.back().id;
+    header.entryCount = uint32(entries.size());
+    header.entriesOffset = AlignIndexOffset(sizeof(header));
+    header.stringCount = uint32(stringOffsets.size());
+    header.stringsOffset = AlignIndexOffset(header.entriesOffset + header.entryCount * sizeof(dbc_indexEntry));
+
+    index.assign(header.stringsOffset + header.stringCount * sizeof(uint32), 0);
+    memcpy(&index[0], &header, sizeof(header));
+    if (!entries.empty())
+    {
+        memcpy(&index[header.entriesOffset], &entries[0], entries.size() * sizeof(dbc_indexEntry));
+    }
+    if (!stringOffsets.empty())
+    {
+        memcpy(&index[header.stringsOffset], &stringOffsets[0], stringOffsets.size() * sizeof(uint32));
+    }
+    return true;
+}
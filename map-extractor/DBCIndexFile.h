@@ -0,0 +1,89 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef DBC_INDEX_FILE_H
+#define DBC_INDEX_FILE_H
+
+#include <stddef.h>
+#include <vector>
+#include <ml/loadlib.h>
+
+// Layout of dbc/<name>.dbc.idx, written next to a DBC file so a loader can
+// map both files and look records up without parsing the DBC:
+//   dbc_indexHeader
+//   dbc_indexEntry entries[entryCount]      sorted by id, at entriesOffset
+//   uint32 strings[stringCount]             sorted, at stringsOffset
+// Each section starts at a multiple of DBC_INDEX_ALIGNMENT. String offsets
+// are relative to the string block of the DBC, which starts at
+// stringBlockOffset in the DBC file.
+
+#define DBC_INDEX_MAGIC         "DBCI"
+#define DBC_INDEX_VERSION       1
+#define DBC_INDEX_ALIGNMENT     4096
+
+/**
+ * @brief
+ *
+ */
+struct dbc_indexHeader
+{
+    uint32 indexMagic;          /**< TODO */
+    uint32 indexVersion;        /**< TODO */
+    uint64 dbcHash;             /**< hashBytes of the whole DBC, to detect a stale index */
+    uint32 dbcSize;             /**< TODO */
+    uint32 recordCount;         /**< TODO */
+    uint32 recordSize;          /**< TODO */
+    uint32 recordsOffset;       /**< start of the first record in the DBC file */
+    uint32 stringBlockOffset;   /**< start of the string block in the DBC file */
+    uint32 stringBlockSize;     /**< TODO */
+    uint32 maxId;               /**< TODO */
+    uint32 entryCount;          /**< TODO */
+    uint32 entriesOffset;       /**< from the start of the index file */
+    uint32 stringCount;         /**< TODO */
+    uint32 stringsOffset;       /**< from the start of the index file */
+    uint32 padding;             /**< TODO */
+};
+
+/**
+ * @brief Row of a record, one per distinct id. With duplicate ids the
+ *        last row is used, like the id lookups of the extractors.
+ *
+ */
+struct dbc_indexEntry
+{
+    uint32 id;                  /**< TODO */
+    uint32 row;                 /**< TODO */
+};
+
+/**
+ * @brief Builds the index file contents for a DBC file
+ *
+ * @param data contents of the DBC file
+ * @param size
+ * @param index receives the index file
+ * @return bool false if the data is not a valid DBC file
+ */
+bool BuildDBCIndex(char const* data, size_t size, std::vector<char>& index);
+
+#endif
@@ -0,0 +1,888 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "HeightPacking.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include <ml/adt.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HEIGHT_PACKING_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// AVX2 kernels are compiled for their own target, so the rest of the
+// extractor keeps running on CPUs without AVX2
+#if defined(__GNUC__) || defined(__clang__)
+#define HEIGHT_PACKING_AVX2_TARGET __attribute__((target("avx2")))
+#define HEIGHT_PACKING_SSE2_TARGET __attribute__((target("sse2")))
+#define HEIGHT_PACKING_F16C_TARGET __attribute__((target("avx2,f16c")))
+#else
+#define HEIGHT_PACKING_AVX2_TARGET
+#define HEIGHT_PACKING_SSE2_TARGET
+#define HEIGHT_PACKING_F16C_TARGET
+#endif
+
+/**
+ * @brief Folds a value into a running min/max the way the original scalar
+ *        loops did: NaN is skipped and on ties the earlier value is kept
+ *
+ * @param h
+ * @param minHeight
+ * @param maxHeight
+ */
+static inline void FoldHeight(float h, float& minHeight, float& maxHeight)
+{
+    if (maxHeight < h)
+    {
+        maxHeight = h;
+    }
+    if (minHeight > h)
+    {
+        minHeight = h;
+    }
+}
+
+/**
+ * @brief Vector reductions do not keep the scan order, so a zero result may
+ *        carry a different sign than the first zero in the data. Restore it.
+ *
+ * @param data
+ * @param count
+ * @param value
+ */
+static inline void FixZeroSign(float const* data, size_t count, float& value)
+{
+    if (value != 0.0f)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (data[i] == 0.0f)
+        {
+            value = data[i];
+            return;
+        }
+    }
+}
+
+static void ClampMinMaxScalar(float* data, size_t count, bool clamp, float limit, float& minHeight, float& maxHeight)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float h = data[i];
+        if (clamp && h < limit)
+        {
+            h = limit;
+            data[i] = h;
+        }
+        FoldHeight(h, minHeight, maxHeight);
+    }
+}
+
+static void QuantizeUInt8Scalar(float const* data, size_t count, float minHeight, float step, uint8* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = uint8((data[i] - minHeight) * step + 0.5f);
+    }
+}
+
+static void QuantizeUInt16Scalar(float const* data, size_t count, float minHeight, float step, uint16* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = uint16((data[i] - minHeight) * step + 0.5f);
+    }
+}
+
+/**
+ * @brief Converts a float to half precision, rounding to nearest even
+ *
+ * Gives the same results as the F16C instructions, including overflow to
+ * infinity, half subnormals and the truncated payload of quiet NaNs.
+ *
+ * @param value
+ * @return uint16
+ */
+static inline uint16 FloatToHalf(float value)
+{
+    uint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32 sign = (bits >> 16) & 0x8000;
+    bits &= 0x7FFFFFFF;
+
+    if (bits >= 0x47800000)             // 65536 and above, infinity or NaN
+    {
+        if (bits > 0x7F800000)
+        {
+            return uint16(sign | 0x7E00 | ((bits >> 13) & 0x3FF));
+        }
+        return uint16(sign | 0x7C00);
+    }
+
+    if (bits < 0x38800000)              // below the smallest normal half
+    {
+        // adding 0.5 moves the value to an exponent whose float step is the
+        // half subnormal step, so the float addition does the rounding
+        float shifted;
+        memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += 0.5f;
+        memcpy(&bits, &shifted, sizeof(bits));
+        return uint16(sign | (bits - 0x3F000000));
+    }
+
+    // rebias the exponent and round the 13 dropped mantissa bits, a carry
+    // out of the mantissa correctly moves to the next exponent or infinity
+    bits += 0xC8000FFF + ((bits >> 13) & 1);
+    return uint16(sign | (bits >> 13));
+}
+
+static void HeightToHalfScalar(float const* data, size_t count, float base, uint16* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = FloatToHalf(data[i] - base);
+    }
+}
+
+#ifdef HEIGHT_PACKING_X86
+
+// _mm_max_ps(a, b) returns b when either operand is NaN, so with the data in
+// the first operand NaN heights are skipped just like the scalar compare.
+// The clamp has the limit first for the same reason: NaN heights stay NaN.
+
+HEIGHT_PACKING_SSE2_TARGET
+static void ClampMinMaxSSE2(float* data, size_t count, bool clamp, float limit, float& minHeight, float& maxHeight)
+{
+    __m128 vlimit = _mm_set1_ps(limit);
+    __m128 vmin = _mm_set1_ps(20000.0f);
+    __m128 vmax = _mm_set1_ps(-20000.0f);
+    float chunkMin = 20000.0f;
+    float chunkMax = -20000.0f;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 h = _mm_loadu_ps(data + i);
+        if (clamp)
+        {
+            h = _mm_max_ps(vlimit, h);
+            _mm_storeu_ps(data + i, h);
+        }
+        vmin = _mm_min_ps(h, vmin);
+        vmax = _mm_max_ps(h, vmax);
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, vmin);
+    for (int l = 0; l < 4; ++l)
+    {
+        if (chunkMin > lanes[l])
+        {
+            chunkMin = lanes[l];
+        }
+    }
+    _mm_storeu_ps(lanes, vmax);
+    for (int l = 0; l < 4; ++l)
+    {
+        if (chunkMax < lanes[l])
+        {
+            chunkMax = lanes[l];
+        }
+    }
+
+    ClampMinMaxScalar(data + i, count - i, clamp, limit, chunkMin, chunkMax);
+
+    FixZeroSign(data, count, chunkMin);
+    FixZeroSign(data, count, chunkMax);
+    if (minHeight > chunkMin)
+    {
+        minHeight = chunkMin;
+    }
+    if (maxHeight < chunkMax)
+    {
+        maxHeight = chunkMax;
+    }
+}
+
+HEIGHT_PACKING_SSE2_TARGET
+static inline __m128i QuantizeSSE2(__m128 h, __m128 vmin, __m128 vstep, __m128 vhalf)
+{
+    // same operation order as the scalar code, truncating conversion
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(h, vmin), vstep), vhalf));
+}
+
+HEIGHT_PACKING_SSE2_TARGET
+static void QuantizeUInt8SSE2(float const* data, size_t count, float minHeight, float step, uint8* out)
+{
+    __m128 vmin = _mm_set1_ps(minHeight);
+    __m128 vstep = _mm_set1_ps(step);
+    __m128 vhalf = _mm_set1_ps(0.5f);
+    // the scalar cast keeps the low byte of the converted integer
+    __m128i vmask = _mm_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i), vmin, vstep, vhalf), vmask);
+        __m128i b = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i + 4), vmin, vstep, vhalf), vmask);
+        __m128i c = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i + 8), vmin, vstep, vhalf), vmask);
+        __m128i d = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i + 12), vmin, vstep, vhalf), vmask);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+
+    QuantizeUInt8Scalar(data + i, count - i, minHeight, step, out + i);
+}
+
+HEIGHT_PACKING_SSE2_TARGET
+static void QuantizeUInt16SSE2(float const* data, size_t count, float minHeight, float step, uint16* out)
+{
+    __m128 vmin = _mm_set1_ps(minHeight);
+    __m128 vstep = _mm_set1_ps(step);
+    __m128 vhalf = _mm_set1_ps(0.5f);
+    __m128i vmask = _mm_set1_epi32(0xFFFF);
+    // SSE2 has no unsigned 32 -> 16 bit pack, bias into the signed range instead
+    __m128i vbias32 = _mm_set1_epi32(0x8000);
+    __m128i vbias16 = _mm_set1_epi16(short(0x8000));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i), vmin, vstep, vhalf), vmask);
+        __m128i b = _mm_and_si128(QuantizeSSE2(_mm_loadu_ps(data + i + 4), vmin, vstep, vhalf), vmask);
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, vbias32), _mm_sub_epi32(b, vbias32));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(packed, vbias16));
+    }
+
+    QuantizeUInt16Scalar(data + i, count - i, minHeight, step, out + i);
+}
+
+HEIGHT_PACKING_AVX2_TARGET
+static void ClampMinMaxAVX2(float* data, size_t count, bool clamp, float limit, float& minHeight, float& maxHeight)
+{
+    __m256 vlimit = _mm256_set1_ps(limit);
+    __m256 vmin = _mm256_set1_ps(20000.0f);
+    __m256 vmax = _mm256_set1_ps(-20000.0f);
+    float chunkMin = 20000.0f;
+    float chunkMax = -20000.0f;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 h = _mm256_loadu_ps(data + i);
+        if (clamp)
+        {
+            h = _mm256_max_ps(vlimit, h);
+            _mm256_storeu_ps(data + i, h);
+        }
+        vmin = _mm256_min_ps(h, vmin);
+        vmax = _mm256_max_ps(h, vmax);
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, vmin);
+    for (int l = 0; l < 8; ++l)
+    {
+        if (chunkMin > lanes[l])
+        {
+            chunkMin = lanes[l];
+        }
+    }
+    _mm256_storeu_ps(lanes, vmax);
+    for (int l = 0; l < 8; ++l)
+    {
+        if (chunkMax < lanes[l])
+        {
+            chunkMax = lanes[l];
+        }
+    }
+
+    ClampMinMaxScalar(data + i, count - i, clamp, limit, chunkMin, chunkMax);
+
+    FixZeroSign(data, count, chunkMin);
+    FixZeroSign(data, count, chunkMax);
+    if (minHeight > chunkMin)
+    {
+        minHeight = chunkMin;
+    }
+    if (maxHeight < chunkMax)
+    {
+        maxHeight = chunkMax;
+    }
+}
+
+HEIGHT_PACKING_AVX2_TARGET
+static inline __m256i QuantizeAVX2(__m256 h, __m256 vmin, __m256 vstep, __m256 vhalf)
+{
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(h, vmin), vstep), vhalf));
+}
+
+HEIGHT_PACKING_AVX2_TARGET
+static void QuantizeUInt8AVX2(float const* data, size_t count, float minHeight, float step, uint8* out)
+{
+    __m256 vmin = _mm256_set1_ps(minHeight);
+    __m256 vstep = _mm256_set1_ps(step);
+    __m256 vhalf = _mm256_set1_ps(0.5f);
+    __m256i vmask = _mm256_set1_epi32(0xFF);
+    // packs work per 128 bit lane, this restores the element order afterwards
+    __m256i vorder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i), vmin, vstep, vhalf), vmask);
+        __m256i b = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i + 8), vmin, vstep, vhalf), vmask);
+        __m256i c = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i + 16), vmin, vstep, vhalf), vmask);
+        __m256i d = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i + 24), vmin, vstep, vhalf), vmask);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, vorder));
+    }
+
+    QuantizeUInt8Scalar(data + i, count - i, minHeight, step, out + i);
+}
+
+HEIGHT_PACKING_AVX2_TARGET
+static void QuantizeUInt16AVX2(float const* data, size_t count, float minHeight, float step, uint16* out)
+{
+    __m256 vmin = _mm256_set1_ps(minHeight);
+    __m256 vstep = _mm256_set1_ps(step);
+    __m256 vhalf = _mm256_set1_ps(0.5f);
+    __m256i vmask = _mm256_set1_epi32(0xFFFF);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i), vmin, vstep, vhalf), vmask);
+        __m256i b = _mm256_and_si256(QuantizeAVX2(_mm256_loadu_ps(data + i + 8), vmin, vstep, vhalf), vmask);
+        __m256i packed = _mm256_packus_epi32(a, b);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    QuantizeUInt16Scalar(data + i, count - i, minHeight, step, out + i);
+}
+
+HEIGHT_PACKING_SSE2_TARGET
+static inline __m128i SelectSSE2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/**
+ * @brief FloatToHalf on four lanes, every case is computed and the right
+ *        one selected per lane. Results are left in the low 16 bits.
+ *
+ */
+HEIGHT_PACKING_SSE2_TARGET
+static inline __m128i FloatToHalfSSE2(__m128 value)
+{
+    __m128i bits = _mm_castps_si128(value);
+    __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+    bits = _mm_and_si128(bits, _mm_set1_epi32(0x7FFFFFFF));
+
+    __m128i isLarge = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x477FFFFF));
+    __m128i isNaN = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x7F800000));
+    __m128i isSmall = _mm_cmplt_epi32(bits, _mm_set1_epi32(0x38800000));
+
+    __m128i mantissa = _mm_srli_epi32(bits, 13);
+    __m128i nan = _mm_or_si128(_mm_set1_epi32(0x7E00), _mm_and_si128(mantissa, _mm_set1_epi32(0x3FF)));
+    __m128i large = SelectSSE2(isNaN, nan, _mm_set1_epi32(0x7C00));
+    __m128i small = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3F000000));
+    __m128i rounding = _mm_add_epi32(_mm_set1_epi32(int(0xC8000FFF)), _mm_and_si128(mantissa, _mm_set1_epi32(1)));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(bits, rounding), 13);
+
+    __m128i half = SelectSSE2(isLarge, large, SelectSSE2(isSmall, small, normal));
+    return _mm_or_si128(half, sign);
+}
+
+HEIGHT_PACKING_SSE2_TARGET
+static void HeightToHalfSSE2(float const* data, size_t count, float base, uint16* out)
+{
+    __m128 vbase = _mm_set1_ps(base);
+    __m128i vbias32 = _mm_set1_epi32(0x8000);
+    __m128i vbias16 = _mm_set1_epi16(short(0x8000));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = FloatToHalfSSE2(_mm_sub_ps(_mm_loadu_ps(data + i), vbase));
+        __m128i b = FloatToHalfSSE2(_mm_sub_ps(_mm_loadu_ps(data + i + 4), vbase));
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, vbias32), _mm_sub_epi32(b, vbias32));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(packed, vbias16));
+    }
+
+    HeightToHalfScalar(data + i, count - i, base, out + i);
+}
+
+HEIGHT_PACKING_F16C_TARGET
+static void HeightToHalfF16C(float const* data, size_t count, float base, uint16* out)
+{
+    __m256 vbase = _mm256_set1_ps(base);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i half = _mm256_cvtps_ph(_mm256_sub_ps(_mm256_loadu_ps(data + i), vbase), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(out + i), half);
+    }
+
+    HeightToHalfScalar(data + i, count - i, base, out + i);
+}
+
+/**
+ * @brief F16C is a separate CPUID bit, AVX2 CPUs without it are not known
+ *        but the check is cheap. The OS support for AVX state is already
+ *        part of the AVX2 detection.
+ *
+ * @return bool
+ */
+static bool DetectF16C()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+    return (ecx & (1 << 29)) != 0;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 29)) != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief
+ *
+ * @return HeightPackingKernel
+ */
+static HeightPackingKernel DetectHeightPackingKernel()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return HEIGHT_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return HEIGHT_KERNEL_SSE2;
+    }
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+        {
+            return HEIGHT_KERNEL_AVX2;
+        }
+    }
+    if (sse2)
+    {
+        return HEIGHT_KERNEL_SSE2;
+    }
+#endif
+    return HEIGHT_KERNEL_SCALAR;
+}
+
+#else
+
+static HeightPackingKernel DetectHeightPackingKernel()
+{
+    return HEIGHT_KERNEL_SCALAR;
+}
+
+static bool DetectF16C()
+{
+    return false;
+}
+
+#endif
+
+static HeightPackingKernel supportedKernel = DetectHeightPackingKernel();   /**< TODO */
+static HeightPackingKernel activeKernel = supportedKernel;                  /**< TODO */
+static bool supportedF16C = DetectF16C();                                   /**< used with the AVX2 kernel */
+
+HeightPackingKernel GetSupportedHeightPackingKernel()
+{
+    return supportedKernel;
+}
+
+void SetHeightPackingKernel(HeightPackingKernel kernel)
+{
+    activeKernel = kernel > supportedKernel ? supportedKernel : kernel;
+}
+
+HeightPackingKernel GetHeightPackingKernel()
+{
+    return activeKernel;
+}
+
+char const* GetHeightPackingKernelName(HeightPackingKernel kernel)
+{
+    switch (kernel)
+    {
+        case HEIGHT_KERNEL_AVX2:
+            return "AVX2";
+        case HEIGHT_KERNEL_SSE2:
+            return "SSE2";
+        default:
+            return "scalar";
+    }
+}
+
+void HeightClampMinMax(float* data, size_t count, bool clamp, float limit, float& minHeight, float& maxHeight)
+{
+    switch (activeKernel)
+    {
+#ifdef HEIGHT_PACKING_X86
+        case HEIGHT_KERNEL_AVX2:
+            ClampMinMaxAVX2(data, count, clamp, limit, minHeight, maxHeight);
+            break;
+        case HEIGHT_KERNEL_SSE2:
+            ClampMinMaxSSE2(data, count, clamp, limit, minHeight, maxHeight);
+            break;
+#endif
+        default:
+            ClampMinMaxScalar(data, count, clamp, limit, minHeight, maxHeight);
+            break;
+    }
+}
+
+void HeightQuantizeUInt8(float const* data, size_t count, float minHeight, float step, uint8* out)
+{
+    switch (activeKernel)
+    {
+#ifdef HEIGHT_PACKING_X86
+        case HEIGHT_KERNEL_AVX2:
+            QuantizeUInt8AVX2(data, count, minHeight, step, out);
+            break;
+        case HEIGHT_KERNEL_SSE2:
+            QuantizeUInt8SSE2(data, count, minHeight, step, out);
+            break;
+#endif
+        default:
+            QuantizeUInt8Scalar(data, count, minHeight, step, out);
+            break;
+    }
+}
+
+void HeightQuantizeUInt16(float const* data, size_t count, float minHeight, float step, uint16* out)
+{
+    switch (activeKernel)
+    {
+#ifdef HEIGHT_PACKING_X86
+        case HEIGHT_KERNEL_AVX2:
+            QuantizeUInt16AVX2(data, count, minHeight, step, out);
+            break;
+        case HEIGHT_KERNEL_SSE2:
+            QuantizeUInt16SSE2(data, count, minHeight, step, out);
+            break;
+#endif
+        default:
+            QuantizeUInt16Scalar(data, count, minHeight, step, out);
+            break;
+    }
+}
+
+void HeightToHalf(float const* data, size_t count, float base, uint16* out)
+{
+    switch (activeKernel)
+    {
+#ifdef HEIGHT_PACKING_X86
+        case HEIGHT_KERNEL_AVX2:
+            if (supportedF16C)
+            {
+                HeightToHalfF16C(data, count, base, out);
+            }
+            else
+            {
+                HeightToHalfSSE2(data, count, base, out);
+            }
+            break;
+        case HEIGHT_KERNEL_SSE2:
+            HeightToHalfSSE2(data, count, base, out);
+            break;
+#endif
+        default:
+            HeightToHalfScalar(data, count, base, out);
+            break;
+    }
+}
+
+float HalfToFloat(uint16 value)
+{
+    uint32 sign = uint32(value & 0x8000) << 16;
+    uint32 exponent = (value >> 10) & 0x1F;
+    uint32 mantissa = value & 0x3FF;
+
+    uint32 bits;
+    if (exponent == 0x1F)
+    {
+        // NaNs come back quiet, like the F16C conversion
+        bits = sign | 0x7F800000 | (mantissa << 13) | (mantissa ? 0x00400000 : 0);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else
+    {
+        // zero or subnormal, mantissa * 2^-24 is exact in a float
+        float result = float(mantissa) * 5.9604644775390625e-8f;
+        return sign ? -result : result;
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+//============================================
+// Micro benchmark
+//============================================
+
+static size_t const V8_COUNT = ADT_GRID_SIZE * ADT_GRID_SIZE;               /**< TODO */
+static size_t const V9_COUNT = (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1);   /**< TODO */
+static float const BENCH_MIN_HEIGHT = -500.0f;                              /**< same as CONF_use_minHeight */
+
+/**
+ * @brief Packed output of one benchmark tile
+ *
+ */
+struct BenchTileResult
+{
+    float minHeight;                    /**< TODO */
+    float maxHeight;                    /**< TODO */
+    std::vector<uint8> uint8_V8;        /**< TODO */
+    std::vector<uint8> uint8_V9;        /**< TODO */
+    std::vector<uint16> uint16_V8;      /**< TODO */
+    std::vector<uint16> uint16_V9;      /**< TODO */
+    std::vector<uint16> half_V8;        /**< TODO */
+    std::vector<uint16> half_V9;        /**< TODO */
+};
+
+/**
+ * @brief Builds a synthetic terrain tile, part of it below the height limit
+ *
+ * @param V8
+ * @param V9
+ * @param scale height range of the tile
+ */
+static void MakeBenchTile(std::vector<float>& V8, std::vector<float>& V9, float scale)
+{
+    V8.resize(V8_COUNT);
+    V9.resize(V9_COUNT);
+    for (size_t i = 0; i < V9_COUNT; ++i)
+    {
+        float x = float(i % (ADT_GRID_SIZE + 1));
+        float y = float(i / (ADT_GRID_SIZE + 1));
+        V9[i] = scale * (sinf(x * 0.07f) * cosf(y * 0.05f)) - (x < 16 ? 600.0f : 0.0f);
+    }
+    for (size_t i = 0; i < V8_COUNT; ++i)
+    {
+        float x = float(i % ADT_GRID_SIZE) + 0.5f;
+        float y = float(i / ADT_GRID_SIZE) + 0.5f;
+        V8[i] = scale * (sinf(x * 0.07f) * cosf(y * 0.05f)) - (x < 16 ? 600.0f : 0.0f);
+    }
+}
+
+/**
+ * @brief The original loops of ConvertADT, used as reference
+ *
+ */
+static void PackTileLegacy(std::vector<float>& V8, std::vector<float>& V9, BenchTileResult& result)
+{
+    float maxHeight = -20000;
+    float minHeight =  20000;
+    for (size_t i = 0; i < V8_COUNT; ++i)
+    {
+        FoldHeight(V8[i], minHeight, maxHeight);
+    }
+    for (size_t i = 0; i < V9_COUNT; ++i)
+    {
+        FoldHeight(V9[i], minHeight, maxHeight);
+    }
+    if (minHeight < BENCH_MIN_HEIGHT)
+    {
+        for (size_t i = 0; i < V8_COUNT; ++i)
+            if (V8[i] < BENCH_MIN_HEIGHT)
+            {
+                V8[i] = BENCH_MIN_HEIGHT;
+            }
+        for (size_t i = 0; i < V9_COUNT; ++i)
+            if (V9[i] < BENCH_MIN_HEIGHT)
+            {
+                V9[i] = BENCH_MIN_HEIGHT;
+            }
+        if (minHeight < BENCH_MIN_HEIGHT)
+        {
+            minHeight = BENCH_MIN_HEIGHT;
+        }
+        if (maxHeight < BENCH_MIN_HEIGHT)
+        {
+            maxHeight = BENCH_MIN_HEIGHT;
+        }
+    }
+
+    float diff = maxHeight - minHeight;
+    float step8 = 255 / diff;
+    float step16 = 65535 / diff;
+    for (size_t i = 0; i < V8_COUNT; ++i)
+    {
+        result.uint8_V8[i] = uint8((V8[i] - minHeight) * step8 + 0.5f);
+        result.uint16_V8[i] = uint16((V8[i] - minHeight) * step16 + 0.5f);
+    }
+    for (size_t i = 0; i < V9_COUNT; ++i)
+    {
+        result.uint8_V9[i] = uint8((V9[i] - minHeight) * step8 + 0.5f);
+        result.uint16_V9[i] = uint16((V9[i] - minHeight) * step16 + 0.5f);
+    }
+    // there is no original half float loop, the scalar conversion is the reference
+    HeightToHalfScalar(&V8[0], V8_COUNT, minHeight, &result.half_V8[0]);
+    HeightToHalfScalar(&V9[0], V9_COUNT, minHeight, &result.half_V9[0]);
+    result.minHeight = minHeight;
+    result.maxHeight = maxHeight;
+}
+
+/**
+ * @brief Packs a tile with the active kernel
+ *
+ */
+static void PackTileKernel(std::vector<float>& V8, std::vector<float>& V9, BenchTileResult& result)
+{
+    float maxHeight = -20000;
+    float minHeight =  20000;
+    HeightClampMinMax(&V8[0], V8_COUNT, true, BENCH_MIN_HEIGHT, minHeight, maxHeight);
+    HeightClampMinMax(&V9[0], V9_COUNT, true, BENCH_MIN_HEIGHT, minHeight, maxHeight);
+
+    float diff = maxHeight - minHeight;
+    HeightQuantizeUInt8(&V8[0], V8_COUNT, minHeight, 255 / diff, &result.uint8_V8[0]);
+    HeightQuantizeUInt8(&V9[0], V9_COUNT, minHeight, 255 / diff, &result.uint8_V9[0]);
+    HeightQuantizeUInt16(&V8[0], V8_COUNT, minHeight, 65535 / diff, &result.uint16_V8[0]);
+    HeightQuantizeUInt16(&V9[0], V9_COUNT, minHeight, 65535 / diff, &result.uint16_V9[0]);
+    HeightToHalf(&V8[0], V8_COUNT, minHeight, &result.half_V8[0]);
+    HeightToHalf(&V9[0], V9_COUNT, minHeight, &result.half_V9[0]);
+    result.minHeight = minHeight;
+    result.maxHeight = maxHeight;
+}
+
+/**
+ * @brief Packs the tile iterations times and returns the time per tile in
+ *        microseconds
+ *
+ */
+static double TimePacking(bool legacy, std::vector<float> const& srcV8, std::vector<float> const& srcV9, int iterations, BenchTileResult& result)
+{
+    std::vector<float> V8, V9;
+    result.uint8_V8.resize(V8_COUNT);
+    result.uint8_V9.resize(V9_COUNT);
+    result.uint16_V8.resize(V8_COUNT);
+    result.uint16_V9.resize(V9_COUNT);
+    result.half_V8.resize(V8_COUNT);
+    result.half_V9.resize(V9_COUNT);
+
+    double total = 0.0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        // every tile starts from unclamped heights, the copy is not timed
+        V8 = srcV8;
+        V9 = srcV9;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (legacy)
+        {
+            PackTileLegacy(V8, V9, result);
+        }
+        else
+        {
+            PackTileKernel(V8, V9, result);
+        }
+        total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    return total / iterations;
+}
+
+/**
+ * @brief
+ *
+ * @param a
+ * @param b
+ * @return bool
+ */
+static bool SameResult(BenchTileResult const& a, BenchTileResult const& b)
+{
+    return memcmp(&a.minHeight, &b.minHeight, sizeof(float)) == 0 &&
+           memcmp(&a.maxHeight, &b.maxHeight, sizeof(float)) == 0 &&
+           a.uint8_V8 == b.uint8_V8 && a.uint8_V9 == b.uint8_V9 &&
+           a.uint16_V8 == b.uint16_V8 && a.uint16_V9 == b.uint16_V9 &&
+           a.half_V8 == b.half_V8 && a.half_V9 == b.half_V9;
+}
+
+void BenchmarkHeightPacking(int iterations)
+{
+    HeightPackingKernel previous = GetHeightPackingKernel();
+    std::vector<float> V8, V9;
+    MakeBenchTile(V8, V9, 1500.0f);
+
+    printf(" Height packing benchmark, %d tiles per kernel (clamp, min/max, uint8, uint16 and half)\n", iterations);
+
+    BenchTileResult reference;
+    double legacyTime = TimePacking(true, V8, V9, iterations, reference);
+    printf("   %-8s %10.2f us/tile\n", "original", legacyTime);
+
+    for (int k = HEIGHT_KERNEL_SCALAR; k <= GetSupportedHeightPackingKernel(); ++k)
+    {
+        SetHeightPackingKernel(HeightPackingKernel(k));
+        BenchTileResult result;
+        double time = TimePacking(false, V8, V9, iterations, result);
+        printf("   %-8s %10.2f us/tile  %5.2fx  %s\n", GetHeightPackingKernelName(HeightPackingKernel(k)), time,
+               legacyTime / time, SameResult(reference, result) ? "identical" : "MISMATCH");
+    }
+
+    SetHeightPackingKernel(previous);
+}
@@ -0,0 +1,139 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef HEIGHT_PACKING_H
+#define HEIGHT_PACKING_H
+
+#include <cstddef>
+#include <ml/loadlib.h>
+
+/**
+ * @brief Instruction sets the height packing kernels are available for
+ *
+ */
+enum HeightPackingKernel
+{
+    HEIGHT_KERNEL_SCALAR = 0,
+    HEIGHT_KERNEL_SSE2   = 1,
+    HEIGHT_KERNEL_AVX2   = 2
+};
+
+/**
+ * @brief Returns the best kernel supported by the running CPU
+ *
+ * @return HeightPackingKernel
+ */
+HeightPackingKernel GetSupportedHeightPackingKernel();
+
+/**
+ * @brief Forces the kernel used by the packing functions, it is capped to
+ *        what the running CPU supports
+ *
+ * @param kernel
+ */
+void SetHeightPackingKernel(HeightPackingKernel kernel);
+
+/**
+ * @brief Returns the kernel used by the packing functions
+ *
+ * @return HeightPackingKernel
+ */
+HeightPackingKernel GetHeightPackingKernel();
+
+/**
+ * @brief
+ *
+ * @param kernel
+ * @return const char
+ */
+char const* GetHeightPackingKernelName(HeightPackingKernel kernel);
+
+/**
+ * @brief Clamps heights to a lower limit and folds them into a min/max range
+ *        in a single pass
+ *
+ * The result matches clamping after the scalar reduction ConvertADT used to
+ * do, including which of +0/-0 is kept and skipping NaN values.
+ *
+ * @param data heights, clamped in place
+ * @param count number of heights
+ * @param clamp whether heights below limit are raised to it
+ * @param limit
+ * @param minHeight running minimum, updated
+ * @param maxHeight running maximum, updated
+ */
+void HeightClampMinMax(float* data, size_t count, bool clamp, float limit, float& minHeight, float& maxHeight);
+
+/**
+ * @brief Stores heights as uint8((v - minHeight) * step + 0.5f)
+ *
+ * @param data
+ * @param count
+ * @param minHeight
+ * @param step
+ * @param out
+ */
+void HeightQuantizeUInt8(float const* data, size_t count, float minHeight, float step, uint8* out);
+
+/**
+ * @brief Stores heights as uint16((v - minHeight) * step + 0.5f)
+ *
+ * @param data
+ * @param count
+ * @param minHeight
+ * @param step
+ * @param out
+ */
+void HeightQuantizeUInt16(float const* data, size_t count, float minHeight, float step, uint16* out);
+
+/**
+ * @brief Stores heights as half floats of (v - base), rounded to nearest even
+ *
+ * The AVX2 kernel uses the F16C conversion when the CPU has it, the other
+ * kernels give bit identical results in software.
+ *
+ * @param data
+ * @param count
+ * @param base
+ * @param out
+ */
+void HeightToHalf(float const* data, size_t count, float base, uint16* out);
+
+/**
+ * @brief Expands a half float, the exact inverse of HeightToHalf without the base
+ *
+ * @param value
+ * @return float
+ */
+float HalfToFloat(uint16 value);
+
+/**
+ * @brief Times the height packing of synthetic tiles with every supported
+ *        kernel against the original scalar loops and prints the results
+ *
+ * @param iterations number of tiles packed per kernel
+ */
+void BenchmarkHeightPacking(int iterations);
+
+#endif
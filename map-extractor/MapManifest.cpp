@@ -0,0 +1,106 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "MapManifest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Text format, one tile per line after the version line:
+//   <map id> <x> <y> <source hash> <build> <settings hash>
+// with both hashes written as 16 hex digits
+static char const MANIFEST_VERSION_LINE[] = "# map-extractor manifest 1\n";
+
+bool MapManifest::load(char const* filename)
+{
+    m_entries.clear();
+
+    FILE* input = fopen(filename, "r");
+    if (!input)
+    {
+        return false;
+    }
+
+    char line[256];
+    if (!fgets(line, sizeof(line), input) || strcmp(line, MANIFEST_VERSION_LINE) != 0)
+    {
+        printf("Ignoring manifest '%s' of an unknown version\n", filename);
+        fclose(input);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), input))
+    {
+        MapManifestEntry entry;
+        unsigned long long sourceHash, settingsHash;
+        if (sscanf(line, "%u %u %u %llx %u %llx", &entry.mapId, &entry.x, &entry.y, &sourceHash, &entry.build, &settingsHash) != 6)
+        {
+            continue;
+        }
+
+        entry.sourceHash = sourceHash;
+        entry.settingsHash = settingsHash;
+        set(entry);
+    }
+
+    fclose(input);
+    return true;
+}
+
+bool MapManifest::save(char const* filename) const
+{
+    FILE* output = fopen(filename, "w");
+    if (!output)
+    {
+        printf("Can not create the manifest '%s'\n", filename);
+        return false;
+    }
+
+    fputs(MANIFEST_VERSION_LINE, output);
+    for (EntryMap::const_iterator itr = m_entries.begin(); itr != m_entries.end(); ++itr)
+    {
+        MapManifestEntry const& entry = itr->second;
+        fprintf(output, "%u %u %u %016llx %u %016llx\n", entry.mapId, entry.x, entry.y,
+                (unsigned long long)entry.sourceHash, entry.build, (unsigned long long)entry.settingsHash);
+    }
+
+    fclose(output);
+    return true;
+}
+
+MapManifestEntry const* MapManifest::find(uint32 mapId, uint32 x, uint32 y) const
+{
+    EntryMap::const_iterator itr = m_entries.find(makeKey(mapId, x, y));
+    return itr != m_entries.end() ? &itr->second : NULL;
+}
+
+void MapManifest::set(MapManifestEntry const& entry)
+{
+    m_entries[makeKey(entry.mapId, entry.x, entry.y)] = entry;
+}
+
+void MapManifest::remove(uint32 mapId, uint32 x, uint32 y)
+{
+    m_entries.erase(makeKey(mapId, x, y));
+}
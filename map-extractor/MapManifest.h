@@ -0,0 +1,120 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef MAP_MANIFEST_H
+#define MAP_MANIFEST_H
+
+#include <map>
+#include <ml/loadlib.h>
+
+/**
+ * @brief What a converted tile was generated from
+ *
+ */
+struct MapManifestEntry
+{
+    uint32 mapId;           /**< TODO */
+    uint32 x;               /**< TODO */
+    uint32 y;               /**< TODO */
+    uint64 sourceHash;      /**< hash of the decompressed ADT */
+    uint32 build;           /**< client build the tile was extracted from */
+    uint64 settingsHash;    /**< hash of the conversion settings and DBC tables used */
+};
+
+/**
+ * @brief List of converted tiles and their inputs, stored as text in
+ *        maps.manifest next to the maps directory
+ *
+ * It is used to skip the conversion of tiles whose inputs did not change
+ * and to find outputs of tiles which no longer exist.
+ */
+class MapManifest
+{
+    public:
+        typedef std::map<uint64, MapManifestEntry> EntryMap;
+
+        /**
+         * @brief
+         *
+         * @param filename
+         * @return bool false if there is no readable manifest
+         */
+        bool load(char const* filename);
+        /**
+         * @brief
+         *
+         * @param filename
+         * @return bool
+         */
+        bool save(char const* filename) const;
+
+        /**
+         * @brief
+         *
+         * @param mapId
+         * @param x
+         * @param y
+         * @return const MapManifestEntry NULL if the tile is not listed
+         */
+        MapManifestEntry const* find(uint32 mapId, uint32 x, uint32 y) const;
+        /**
+         * @brief Adds or replaces the entry of a tile
+         *
+         * @param entry
+         */
+        void set(MapManifestEntry const& entry);
+        /**
+         * @brief
+         *
+         * @param mapId
+         * @param x
+         * @param y
+         */
+        void remove(uint32 mapId, uint32 x, uint32 y);
+
+        /**
+         * @brief
+         *
+         * @return const EntryMap
+         */
+        EntryMap const& getEntries() const { return m_entries; }
+
+        /**
+         * @brief
+         *
+         * @param mapId
+         * @param x
+         * @param y
+         * @return uint64
+         */
+        static uint64 makeKey(uint32 mapId, uint32 x, uint32 y)
+        {
+            return (uint64(mapId) << 16) | (y << 8) | x;
+        }
+
+    private:
+        EntryMap m_entries; /**< TODO */
+};
+
+#endif
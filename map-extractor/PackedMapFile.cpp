@@ -0,0 +1,126 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "PackedMapFile.h"
+
+#include <string.h>
+#include <vector>
+
+PackedMapWriter::PackedMapWriter() : m_file(NULL), m_offset(0)
+{
+    memset(&m_header, 0, sizeof(m_header));
+    memset(m_index, 0, sizeof(m_index));
+}
+
+PackedMapWriter::~PackedMapWriter()
+{
+    close();
+}
+
+/**
+ * @brief Rounds an offset up to the tile alignment
+ *
+ * @param offset
+ * @return uint32
+ */
+static uint32 AlignTileOffset(uint32 offset)
+{
+    return (offset + MAP_PACKED_ALIGNMENT - 1) & ~uint32(MAP_PACKED_ALIGNMENT - 1);
+}
+
+bool PackedMapWriter::create(char const* filename, uint32 mapId, uint32 versionMagic, uint32 build)
+{
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+    {
+        printf("Can not create the output file '%s'\n", filename);
+        return false;
+    }
+
+    m_filename = filename;
+    m_header.packMagic = *(uint32 const*)MAP_PACKED_MAGIC;
+    m_header.versionMagic = versionMagic;
+    m_header.buildMagic = build;
+    m_header.mapId = mapId;
+    m_header.tileCount = 0;
+    m_header.tileAlignment = MAP_PACKED_ALIGNMENT;
+    memset(m_index, 0, sizeof(m_index));
+
+    // header and index are rewritten once all tiles are known
+    fwrite(&m_header, sizeof(m_header), 1, m_file);
+    fwrite(m_index, sizeof(m_index), 1, m_file);
+    m_offset = sizeof(m_header) + sizeof(m_index);
+    return true;
+}
+
+bool PackedMapWriter::addTile(uint32 x, uint32 y, void const* data, uint32 size)
+{
+    if (!m_file || x >= MAP_PACKED_GRID_SIZE || y >= MAP_PACKED_GRID_SIZE)
+    {
+        return false;
+    }
+
+    uint32 offset = AlignTileOffset(m_offset);
+    if (offset < m_offset || offset + size < offset)
+    {
+        printf("Packed map file '%s' exceeds 4GB, tile %u,%u skipped\n", m_filename.c_str(), x, y);
+        return false;
+    }
+
+    if (offset > m_offset)
+    {
+        std::vector<char> padding(offset - m_offset, 0);
+        fwrite(&padding[0], padding.size(), 1, m_file);
+    }
+
+    if (fwrite(data, size, 1, m_file) != 1)
+    {
+        printf("Can not write tile %u,%u to '%s'\n", x, y, m_filename.c_str());
+        return false;
+    }
+
+    if (!m_index[y][x].size)
+    {
+        ++m_header.tileCount;
+    }
+    m_index[y][x].offset = offset;
+    m_index[y][x].size = size;
+    m_offset = offset + size;
+    return true;
+}
+
+bool PackedMapWriter::close()
+{
+    if (!m_file)
+    {
+        return false;
+    }
+
+    fseek(m_file, 0, SEEK_SET);
+    fwrite(&m_header, sizeof(m_header), 1, m_file);
+    bool ok = fwrite(m_index, sizeof(m_index), 1, m_file) == 1;
+    fclose(m_file);
+    m_file = NULL;
+    return ok;
+}
@@ -0,0 +1,121 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef PACKED_MAP_FILE_H
+#define PACKED_MAP_FILE_H
+
+#include <stdio.h>
+#include <string>
+#include <ml/loadlib.h>
+
+// Layout of maps/%03u.pmap, one file holding all tiles of a map:
+//   map_packedHeader
+//   map_packedTile index[MAP_PACKED_GRID_SIZE][MAP_PACKED_GRID_SIZE]   (y, x)
+//   tile blobs, each starting at a multiple of tileAlignment
+// Every blob is the unchanged contents of the matching .map file, so all
+// offsets inside a tile stay relative to the start of its blob.
+// A copy of these definitions lives in Movemap-Generator/MangosMap.h
+
+#define MAP_PACKED_MAGIC        "MPAK"
+#define MAP_PACKED_GRID_SIZE    64
+#define MAP_PACKED_ALIGNMENT    4096
+
+/**
+ * @brief
+ *
+ */
+struct map_packedHeader
+{
+    uint32 packMagic;       /**< TODO */
+    uint32 versionMagic;    /**< same as in the header of every tile */
+    uint32 buildMagic;      /**< TODO */
+    uint32 mapId;           /**< TODO */
+    uint32 tileCount;       /**< TODO */
+    uint32 tileAlignment;   /**< TODO */
+};
+
+/**
+ * @brief Index entry of a tile, size 0 if the tile does not exist
+ *
+ */
+struct map_packedTile
+{
+    uint32 offset;          /**< from the start of the file */
+    uint32 size;            /**< TODO */
+};
+
+/**
+ * @brief Writes the tiles of a single map into a packed map file
+ *
+ */
+class PackedMapWriter
+{
+    public:
+        /**
+         * @brief
+         *
+         */
+        PackedMapWriter();
+        /**
+         * @brief
+         *
+         */
+        ~PackedMapWriter();
+
+        /**
+         * @brief Creates the file and reserves room for the header and index
+         *
+         * @param filename
+         * @param mapId
+         * @param versionMagic
+         * @param build
+         * @return bool
+         */
+        bool create(char const* filename, uint32 mapId, uint32 versionMagic, uint32 build);
+        /**
+         * @brief Appends a tile at the next aligned offset
+         *
+         * @param x
+         * @param y
+         * @param data contents of the tile's .map file
+         * @param size
+         * @return bool
+         */
+        bool addTile(uint32 x, uint32 y, void const* data, uint32 size);
+        /**
+         * @brief Writes the header and index and closes the file
+         *
+         * @return bool
+         */
+        bool close();
+
+    private:
+        FILE* m_file;                                                       /**< TODO */
+        std::string m_filename;                                             /**< TODO */
+        map_packedHeader m_header;                                          /**< TODO */
+        map_packedTile m_index[MAP_PACKED_GRID_SIZE][MAP_PACKED_GRID_SIZE]; /**< TODO */
+        uint32 m_offset;                                                    /**< end of the data written so far */
+};
+
+#endif
@@ -23,14 +23,30 @@
  */
 
 #include <stdio.h>
+#include <math.h>
 #include <set>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "dbcfile.h"
+#include "DBCTable.h"
 #include <ml/mpq.h>
 
 #include <ml/adt.h>
 #include <ml/wdt.h>
 #include "ExtractorCommon.h"
+#include "ConcurrentMPQ.h"
+#include "MPQFileIndex.h"
+#include "MPQFileCache.h"
+#include "BoundedQueue.h"
+#include "HeightPacking.h"
+#include "PackedMapFile.h"
+#include "MapManifest.h"
+#include "DBCIndexFile.h"
 
 #ifndef WIN32
 #include <unistd.h>
@@ -58,6 +74,7 @@ uint16* LiqType;                    /**< TODO */
 char output_path[128] = ".";        /**< TODO */
 char input_path[128] = ".";         /**< TODO */
 uint32 maxAreaId = 0;               /**< TODO */
+uint32 maxLiquidTypeId = 0;         /**< TODO */
 int iCoreNumber = 0;
 /**
  * @brief Data types which can be extracted
@@ -79,6 +96,24 @@ float CONF_float_to_int16_limit    = 2048.0f;   /**< Max accuracy = val/65536 */
 float CONF_flat_height_delta_limit = 0.005f;    /**< If max - min less this value - surface is flat */
 float CONF_flat_liquid_delta_limit = 0.001f;    /**< If max - min less this value - liquid surface is flat */
 
+int   CONF_threads                 = 1;         /**< Number of workers converting map tiles and writing DBC files */
+int   CONF_read_queue              = 8;         /**< Loaded ADTs buffered ahead of the converters */
+int   CONF_write_queue             = 16;        /**< Converted tiles buffered ahead of the writer */
+bool  CONF_packed                  = false;     /**< Store the tiles of a map in one packed file */
+bool  CONF_incremental             = false;     /**< Skip tiles whose inputs did not change since the last run */
+bool  CONF_cell_packing            = false;     /**< Allows int packing with a separate range per cell */
+bool  CONF_float16                 = false;     /**< Store float heights and liquid heights as half floats */
+bool  CONF_sparse_liquid           = false;     /**< Store liquid per cell when smaller than the bounding box */
+bool  CONF_archive_order           = true;      /**< Read the ADTs in the order they are stored in the archives */
+bool  CONF_plan                    = false;     /**< Only list the tiles which would be converted */
+int   CONF_check_threads           = 0;         /**< Compare the tiles converted on 1 and on this many threads, 0 to extract */
+bool  CONF_dbc_index               = false;     /**< Write an index file next to each DBC file */
+int   CONF_mpq_stress              = 0;         /**< Threads reading all archive files at once, 0 to extract */
+char const* CONF_cache_dir         = NULL;      /**< Directory of decompressed archive files, NULL for none */
+uint64 CONF_cache_size             = 4096;      /**< Size limit of the cache directory in MB */
+std::set<uint32> CONF_maps;                     /**< Ids of the maps to extract, all if empty */
+std::set<std::pair<uint32, uint32> > CONF_tiles; /**< Tiles (x, y) to extract from each map, all if empty */
+
 int MAP_LIQUID_TYPE_NO_WATER = 0x00;
 int MAP_LIQUID_TYPE_MAGMA    = 0x01;
 int MAP_LIQUID_TYPE_OCEAN    = 0x02;
@@ -117,6 +152,55 @@ void Usage(char* prg)
     printf("                         size, but also accuracy\n");
     printf("   -e, --extract #       extract specified client data. 1 = maps, 2 = DBCs,\n");
     printf("                         3 = both. Defaults to extracting both.\n");
+    printf("   -t, --threads #       number of worker threads converting map tiles\n");
+    printf("                         and writing dbc files. Defaults to 1.\n");
+    printf("   --read-queue #        ADTs loaded ahead of the converters when using\n");
+    printf("                         more than one thread. Defaults to 8.\n");
+    printf("   --write-queue #       converted tiles waiting for the writer when using\n");
+    printf("                         more than one thread. Defaults to 16.\n");
+    printf("   --map #[,#]           only extract the maps with these ids.\n");
+    printf("   --tile #,#            only extract tile x,y of the selected maps, can\n");
+    printf("                         be given more than once. x is the first number\n");
+    printf("                         of the ADT name, as with --tile of the mmap\n");
+    printf("                         generator. Not possible with --packed.\n");
+    printf("   --plan                list the ADTs which would be converted and their\n");
+    printf("                         compressed size without extracting anything.\n");
+    printf("   --check-threads #     convert the selected tiles on 1 and on # threads,\n");
+    printf("                         compare the .map contents and exit. Nothing is\n");
+    printf("                         written.\n");
+    printf("   --read-order #        read the ADTs in archive order (1) or map by map\n");
+    printf("                         (0). Defaults to 1.\n");
+    printf("   --cache <path>        keep decompressed archive files in path, shared\n");
+    printf("                         with the vmap extractor, and map them on later\n");
+    printf("                         runs instead of decompressing them again.\n");
+    printf("   --cache-size #        size limit of the cache in MB, the least recently\n");
+    printf("                         used files are removed. Defaults to 4096.\n");
+    printf("   --dbc-index #         write a .dbc.idx file next to each dbc file with\n");
+    printf("                         its ids sorted and its string offsets (1), for\n");
+    printf("                         loaders which map the files. Defaults to 0.\n");
+    printf("   -p, --packed #        store all tiles of a map in a single packed .pmap\n");
+    printf("                         file (1) instead of one .map per tile (0).\n");
+    printf("                         Defaults to 0.\n");
+    printf("   --cell-packing #      with --flat, pack heights with a separate range for\n");
+    printf("                         each cell (1) when the tile range is too large.\n");
+    printf("                         Defaults to 0.\n");
+    printf("   --fp16 #              store heights which are not packed as int values\n");
+    printf("                         and liquid heights as half floats (1).\n");
+    printf("                         Defaults to 0.\n");
+    printf("   --sparse-liquid #     store liquid heights only for the cells with\n");
+    printf("                         liquid (1) when that is smaller than the\n");
+    printf("                         bounding box of all liquid. Defaults to 0.\n");
+    printf("   --fp16-report [path]  print the error half floats would give the .map\n");
+    printf("                         and .pmap files in path and exit. Defaults to\n");
+    printf("                         ./maps, no client data is needed.\n");
+    printf("   --incremental #       only convert tiles whose ADT, build or settings\n");
+    printf("                         changed since the last run (1) and remove\n");
+    printf("                         tiles which no longer exist. Defaults to 0.\n");
+    printf("   --benchmark-heights # time the height packing kernels on # synthetic\n");
+    printf("                         tiles and exit, no client data is needed.\n");
+    printf("   --mpq-stress #        read every file of the archives on # threads at\n");
+    printf("                         once, compare them with a single threaded read\n");
+    printf("                         and exit.\n");
     printf("\n");
     printf(" Example:\n");
     printf(" - use input path and do not flatten maps:\n");
@@ -189,12 +273,224 @@ bool HandleArgs(int argc, char** argv)
                 Usage(argv[0]);
             }
         }
+        else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            int threads = atoi(param);
+            if (threads > 0)
+            {
+                CONF_threads = threads;
+            }
+            else
+            {
+                printf("invalid option for '--threads', using single threaded conversion\n");
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--packed") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_packed = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--map") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            for (char* id = strtok(param, ","); id; id = strtok(NULL, ","))
+            {
+                CONF_maps.insert(uint32(atoi(id)));
+            }
+        }
+        else if (strcmp(argv[i], "--tile") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            char* stileX = strtok(param, ",");
+            char* stileY = strtok(NULL, ",");
+            int tileX = stileX ? atoi(stileX) : -1;
+            int tileY = stileY ? atoi(stileY) : -1;
+            if (tileX < 0 || tileX >= WDT_MAP_SIZE || tileY < 0 || tileY >= WDT_MAP_SIZE)
+            {
+                printf("invalid tile coords.\n");
+                return false;
+            }
+
+            CONF_tiles.insert(std::pair<uint32, uint32>(tileX, tileY));
+        }
+        else if (strcmp(argv[i], "--plan") == 0)
+        {
+            CONF_plan = true;
+        }
+        else if (strcmp(argv[i], "--check-threads") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_check_threads = atoi(param);
+            if (CONF_check_threads <= 1)
+            {
+                printf("invalid option for '--check-threads', using 4 threads\n");
+                CONF_check_threads = 4;
+            }
+        }
+        else if (strcmp(argv[i], "--read-order") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_archive_order = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--dbc-index") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_dbc_index = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--cell-packing") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_cell_packing = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--fp16") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_float16 = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--sparse-liquid") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_sparse_liquid = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--incremental") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_incremental = atoi(param) != 0;
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_cache_dir = param;
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            int size = atoi(param);
+            if (size > 0)
+            {
+                CONF_cache_size = size;
+            }
+            else
+            {
+                printf("invalid option for '--cache-size', using 4096 MB\n");
+            }
+        }
+        else if (strcmp(argv[i], "--mpq-stress") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            CONF_mpq_stress = atoi(param);
+            if (CONF_mpq_stress <= 0)
+            {
+                printf("invalid option for '--mpq-stress', using 4 threads\n");
+                CONF_mpq_stress = 4;
+            }
+        }
+        else if (strcmp(argv[i], "--read-queue") == 0 || strcmp(argv[i], "--write-queue") == 0)
+        {
+            char const* option = argv[i];
+            param = argv[++i];
+            if (!param)
+            {
+                return false;
+            }
+
+            int depth = atoi(param);
+            if (depth <= 0)
+            {
+                printf("invalid option for '%s', using the default queue depth\n", option);
+            }
+            else if (strcmp(option, "--read-queue") == 0)
+            {
+                CONF_read_queue = depth;
+            }
+            else
+            {
+                CONF_write_queue = depth;
+            }
+        }
         else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
         {
             Usage(argv[0]);
         }
     }
 
+    // planning and the thread check only need the archives, nothing is written
+    if (CONF_plan || CONF_check_threads)
+    {
+        CONF_extract = EXTRACT_MAP;
+    }
+
     return true;
 
 }
@@ -245,18 +541,20 @@ uint32 ReadMapDBC()
     printf("\n Reading maps from Map.dbc... ");
     DBCFile dbc("DBFilesClient\\Map.dbc");
 
-    if (!dbc.open())
+    DBCTable<MapDBC> table(dbc);
+    if (!dbc.open() || !table.open())
     {
         printf("Fatal error: Could not read Map.dbc!\n");
         exit(1);
     }
 
-    size_t map_count = dbc.getRecordCount();
+    size_t map_count = table.size();
     map_ids = new map_id[map_count];
     for (uint32 x = 0; x < map_count; ++x)
     {
-        map_ids[x].id = dbc.getRecord(x).getUInt(0);
-        strcpy(map_ids[x].name, dbc.getRecord(x).getString(1));
+        DBCTable<MapDBC>::Row row = table[x];
+        map_ids[x].id = row.getUInt<MapDBC::ID>();
+        strcpy(map_ids[x].name, row.getString<MapDBC::InternalName>());
     }
     printf(" Success! %lu maps loaded.\n", map_count);
     return map_count;
@@ -271,23 +569,25 @@ void ReadAreaTableDBC()
     printf("\n Read areas from AreaTable.dbc ...");
     DBCFile dbc("DBFilesClient\\AreaTable.dbc");
 
-    if (!dbc.open())
+    DBCTable<AreaTableDBC> table(dbc);
+    if (!dbc.open() || !table.open())
     {
         printf("Fatal error: Could not read AreaTable.dbc!\n");
         exit(1);
     }
 
-    size_t area_count = dbc.getRecordCount();
-    size_t maxid = dbc.getMaxId();
+    size_t area_count = table.size();
+    size_t maxid = table.getMaxId();
     areas = new uint16[maxid + 1];
     memset(areas, 0xff, (maxid + 1) * sizeof(uint16));
 
     for (uint32 x = 0; x < area_count; ++x)
     {
-        areas[dbc.getRecord(x).getUInt(0)] = dbc.getRecord(x).getUInt(3);
+        DBCTable<AreaTableDBC>::Row row = table[x];
+        areas[row.getUInt<AreaTableDBC::ID>()] = row.getUInt<AreaTableDBC::ExploreFlag>();
     }
 
-    maxAreaId = dbc.getMaxId();
+    maxAreaId = maxid;
 
     printf(" Success! %lu areas loaded.\n", area_count);
 }
@@ -300,22 +600,26 @@ void ReadLiquidTypeTableDBC()
 {
     printf("\n Reading liquid types from LiquidType.dbc...");
     DBCFile dbc("DBFilesClient\\LiquidType.dbc");
-    if (!dbc.open())
+    DBCTable<LiquidTypeDBC> table(dbc);
+    if (!dbc.open() || !table.open())
     {
         printf("Fatal error: Could not read LiquidType.dbc!\n");
         exit(1);
     }
 
-    size_t LiqType_count = dbc.getRecordCount();
-    size_t LiqType_maxid = dbc.getMaxId();
+    size_t LiqType_count = table.size();
+    size_t LiqType_maxid = table.getMaxId();
     LiqType = new uint16[LiqType_maxid + 1];
     memset(LiqType, 0xff, (LiqType_maxid + 1) * sizeof(uint16));
 
     for (uint32 x = 0; x < LiqType_count; ++x)
     {
-        LiqType[dbc.getRecord(x).getUInt(0)] = dbc.getRecord(x).getUInt(3);
+        DBCTable<LiquidTypeDBC>::Row row = table[x];
+        LiqType[row.getUInt<LiquidTypeDBC::ID>()] = row.getUInt<LiquidTypeDBC::Type>();
     }
 
+    maxLiquidTypeId = LiqType_maxid;
+
     printf(" Success! %lu liquid types loaded.\n", LiqType_count);
 }
 
@@ -365,6 +669,8 @@ struct map_areaHeader
 #define MAP_HEIGHT_NO_HEIGHT  0x0001
 #define MAP_HEIGHT_AS_INT16   0x0002
 #define MAP_HEIGHT_AS_INT8    0x0004
+#define MAP_HEIGHT_CELL_PACKED 0x0008   // int values relative to a base and step per cell
+#define MAP_HEIGHT_AS_FLOAT16 0x0010    // half floats relative to (gridHeight + gridMaxHeight) / 2
 
 /**
  * @brief
@@ -386,6 +692,12 @@ struct map_heightHeader
 
 #define MAP_LIQUID_NO_TYPE    0x0001
 #define MAP_LIQUID_NO_HEIGHT  0x0002
+#define MAP_LIQUID_HEIGHT_AS_FLOAT16 0x0004 // half floats relative to liquidLevel
+#define MAP_LIQUID_SPARSE     0x0008    // per cell liquid instead of the bounding box, see ConvertADT
+
+// half float stored for points without liquid, -infinity never comes out of a
+// real height since those are relative to the lowest one
+#define MAP_LIQUID_HALF_NO_HEIGHT 0xFC00
 
 /**
  * @brief
@@ -425,111 +737,359 @@ float selectUInt16StepStore(float maxDiff)
     return 65535 / maxDiff;
 }
 
-uint16 area_flags[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];      /**< Temporary grid data store */
-
-float V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                         /**< TODO */
-float V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];                 /**< TODO */
-uint16 uint16_V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                 /**< TODO */
-uint16 uint16_V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];         /**< TODO */
-uint8  uint8_V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                  /**< TODO */
-uint8  uint8_V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];          /**< TODO */
-
-uint16 liquid_entry[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];    /**< TODO */
-uint8 liquid_flags[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];     /**< TODO */
-bool  liquid_show[ADT_GRID_SIZE][ADT_GRID_SIZE];                /**< TODO */
-float liquid_height[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];      /**< TODO */
-
 /**
- * @brief
+ * @brief Temporary grid data store used while converting a single ADT
  *
- * @param filename
- * @param filename2
- * @param build
- * @return bool
+ * Each conversion worker owns its own context, so several tiles can be
+ * converted at the same time.
  */
-bool ConvertADT(char* filename, char* filename2, uint32 build)
+struct ConvertContext
 {
-    ADT_file adt;
+    uint16 area_flags[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];      /**< TODO */
+
+    float V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                         /**< TODO */
+    float V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];                 /**< TODO */
+    uint16 uint16_V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                 /**< TODO */
+    uint16 uint16_V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];         /**< TODO */
+    uint8  uint8_V8[ADT_GRID_SIZE][ADT_GRID_SIZE];                  /**< TODO */
+    uint8  uint8_V9[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];          /**< TODO */
+
+    uint16 liquid_entry[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];    /**< TODO */
+    uint8 liquid_flags[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];     /**< TODO */
+    bool  liquid_show[ADT_GRID_SIZE][ADT_GRID_SIZE];                /**< TODO */
+    float liquid_height[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1];      /**< TODO */
+    uint16 liquid_height_half[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1]; /**< rows of the stored liquid area */
+    uint16 liquid_cells[ADT_CELLS_PER_GRID];                        /**< bit x of row y is set for cells with liquid */
+    uint64 liquid_cell_show[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID]; /**< liquid_show of a cell, bit y * 8 + x */
+
+    float cell_minHeight[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];   /**< TODO */
+    float cell_maxHeight[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];   /**< TODO */
+    float cell_step[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID];        /**< TODO */
+};
 
-    if (!adt.loadFile(filename))
-    {
-        return false;
-    }
+/**
+ * @brief Cell a row or column of the V8/V9 grids belongs to, V9 points on
+ *        the border of two cells go to the higher one, row or column 8 * k
+ *        to cell k, and the last V9 row and column to the last cell
+ *
+ * @param pos
+ * @return int
+ */
+inline int GetHeightCell(int pos)
+{
+    int cell = pos / ADT_CELL_SIZE;
+    return cell < ADT_CELLS_PER_GRID ? cell : ADT_CELLS_PER_GRID - 1;
+}
 
-    adt_MCIN* cells = adt.a_grid->getMCIN();
-    if (!cells)
+/**
+ * @brief Finds the height range of every cell
+ *
+ * @param ctx
+ * @return float the largest range of a single cell
+ */
+float GetCellHeightRanges(ConvertContext& ctx)
+{
+    for (int y = 0; y < ADT_CELLS_PER_GRID; ++y)
     {
-        printf("Can not find cells in '%s'\n", filename);
-        return false;
+        for (int x = 0; x < ADT_CELLS_PER_GRID; ++x)
+        {
+            ctx.cell_minHeight[y][x] =  20000;
+            ctx.cell_maxHeight[y][x] = -20000;
+        }
     }
 
-    memset(liquid_show, 0, sizeof(liquid_show));
-    memset(liquid_flags, 0, sizeof(liquid_flags));
-    memset(liquid_entry, 0, sizeof(liquid_entry));
-
-    // Prepare map header
-    map_fileheader map;
-    map.mapMagic = *(uint32 const*)MAP_MAGIC;
-    map.versionMagic = *(uint32 const*)MAP_VERSION_MAGIC;
-    map.buildMagic = build;
-
-    // Get area flags data
-    for (int i = 0; i < ADT_CELLS_PER_GRID; i++)
+    for (int y = 0; y <= ADT_GRID_SIZE; ++y)
     {
-        for (int j = 0; j < ADT_CELLS_PER_GRID; j++)
+        for (int x = 0; x <= ADT_GRID_SIZE; ++x)
         {
-            adt_MCNK* cell = cells->getMCNK(i, j);
-            uint32 areaid = cell->areaid;
-            if (areaid && areaid <= maxAreaId)
+            float h = ctx.V9[y][x];
+            float& cellMin = ctx.cell_minHeight[GetHeightCell(y)][GetHeightCell(x)];
+            float& cellMax = ctx.cell_maxHeight[GetHeightCell(y)][GetHeightCell(x)];
+            if (cellMax < h)
             {
-                if (areas[areaid] != 0xffff)
+                cellMax = h;
+            }
+            if (cellMin > h)
+            {
+                cellMin = h;
+            }
+            if (y < ADT_GRID_SIZE && x < ADT_GRID_SIZE)
+            {
+                h = ctx.V8[y][x];
+                if (cellMax < h)
                 {
-                    area_flags[i][j] = areas[areaid];
-                    continue;
+                    cellMax = h;
+                }
+                if (cellMin > h)
+                {
+                    cellMin = h;
                 }
-                printf("File: %s\nCan not find area flag for area %u [%d, %d].\n", filename, areaid, cell->ix, cell->iy);
             }
-            area_flags[i][j] = 0xffff;
         }
     }
-    //============================================
-    // Try pack area data
-    //============================================
-    bool fullAreaData = false;
-    uint32 areaflag = area_flags[0][0];
-    for (int y = 0; y < ADT_CELLS_PER_GRID; y++)
+
+    float maxDiff = 0.0f;
+    for (int y = 0; y < ADT_CELLS_PER_GRID; ++y)
     {
-        for (int x = 0; x < ADT_CELLS_PER_GRID; x++)
+        for (int x = 0; x < ADT_CELLS_PER_GRID; ++x)
         {
-            if (area_flags[y][x] != areaflag)
+            float diff = ctx.cell_maxHeight[y][x] - ctx.cell_minHeight[y][x];
+            if (maxDiff < diff)
             {
-                fullAreaData = true;
-                break;
+                maxDiff = diff;
             }
         }
     }
+    return maxDiff;
+}
 
-    map.areaMapOffset = sizeof(map);
-    map.areaMapSize   = sizeof(map_areaHeader);
-
-    map_areaHeader areaHeader;
-    areaHeader.fourcc = *(uint32 const*)MAP_AREA_MAGIC;
-    areaHeader.flags = 0;
-    if (fullAreaData)
-    {
-        areaHeader.gridArea = 0;
-        map.areaMapSize += sizeof(area_flags);
-    }
-    else
+/**
+ * @brief Quantizes a height grid relative to the range of each cell
+ *
+ * @param heights
+ * @param packed
+ * @param size width and height of the grid
+ * @param ctx holds the cell ranges and steps
+ */
+template<class T>
+void QuantizeCellHeights(float const* heights, T* packed, int size, ConvertContext const& ctx)
+{
+    for (int y = 0; y < size; ++y)
     {
-        areaHeader.flags |= MAP_AREA_NO_AREA;
-        areaHeader.gridArea = (uint16)areaflag;
+        for (int x = 0; x < size; ++x)
+        {
+            int cy = GetHeightCell(y);
+            int cx = GetHeightCell(x);
+            packed[y * size + x] = T((heights[y * size + x] - ctx.cell_minHeight[cy][cx]) * ctx.cell_step[cy][cx] + 0.5f);
+        }
     }
+}
 
-    //
-    // Get Height map from grid
-    //
-    for (int i = 0; i < ADT_CELLS_PER_GRID; i++)
+/**
+ * @brief Appends a block of raw data to an output buffer
+ *
+ * @param output
+ * @param data
+ * @param size
+ */
+void AppendData(std::vector<char>& output, void const* data, size_t size)
+{
+    char const* bytes = (char const*)data;
+    output.insert(output.end(), bytes, bytes + size);
+}
+
+/**
+ * @brief Fills the liquid cell table and the liquid_show bits of every cell
+ *
+ * @param ctx
+ * @return uint32 number of cells with liquid
+ */
+uint32 GetLiquidCells(ConvertContext& ctx)
+{
+    uint32 count = 0;
+    for (int cy = 0; cy < ADT_CELLS_PER_GRID; ++cy)
+    {
+        ctx.liquid_cells[cy] = 0;
+        for (int cx = 0; cx < ADT_CELLS_PER_GRID; ++cx)
+        {
+            uint64 show = 0;
+            for (int y = 0; y < ADT_CELL_SIZE; ++y)
+            {
+                for (int x = 0; x < ADT_CELL_SIZE; ++x)
+                {
+                    if (ctx.liquid_show[cy * ADT_CELL_SIZE + y][cx * ADT_CELL_SIZE + x])
+                    {
+                        show |= uint64(1) << (y * ADT_CELL_SIZE + x);
+                    }
+                }
+            }
+
+            ctx.liquid_cell_show[cy][cx] = show;
+            if (show)
+            {
+                ctx.liquid_cells[cy] |= 1 << cx;
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief HeightToHalf for liquid heights relative to liquidLevel
+ *
+ * Points without liquid hold CONF_use_minHeight. Rounded to a half float
+ * that would read back as a height close to it, which the mmap generator
+ * takes for real water, so they get MAP_LIQUID_HALF_NO_HEIGHT instead.
+ *
+ * @param heights
+ * @param count
+ * @param liquidLevel
+ * @param out
+ */
+void LiquidHeightToHalf(float const* heights, size_t count, float liquidLevel, uint16* out)
+{
+    HeightToHalf(heights, count, liquidLevel, out);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (heights[i] == CONF_use_minHeight)
+        {
+            out[i] = MAP_LIQUID_HALF_NO_HEIGHT;
+        }
+    }
+}
+
+/**
+ * @brief Appends liquid in the MAP_LIQUID_SPARSE layout:
+ *        uint16 cells[16], bit x of row y set for cells with liquid, then for
+ *        each of those cells in row order its uint64 liquid_show bits and the
+ *        9x9 heights of its corners, as floats or half floats. Corners
+ *        without liquid, such as those shared with a cell without liquid,
+ *        hold CONF_use_minHeight and are stored like in the bounding box
+ *
+ * @param output
+ * @param ctx GetLiquidCells must have been called
+ * @param liquidHeader
+ */
+void AppendLiquidCells(std::vector<char>& output, ConvertContext const& ctx, map_liquidHeader const& liquidHeader)
+{
+    AppendData(output, ctx.liquid_cells, sizeof(ctx.liquid_cells));
+    for (int cy = 0; cy < ADT_CELLS_PER_GRID; ++cy)
+    {
+        for (int cx = 0; cx < ADT_CELLS_PER_GRID; ++cx)
+        {
+            if (!(ctx.liquid_cells[cy] & (1 << cx)))
+            {
+                continue;
+            }
+
+            AppendData(output, &ctx.liquid_cell_show[cy][cx], sizeof(uint64));
+            for (int y = 0; y <= ADT_CELL_SIZE; ++y)
+            {
+                float const* row = &ctx.liquid_height[cy * ADT_CELL_SIZE + y][cx * ADT_CELL_SIZE];
+                if (liquidHeader.flags & MAP_LIQUID_HEIGHT_AS_FLOAT16)
+                {
+                    uint16 half[ADT_CELL_SIZE + 1];
+                    LiquidHeightToHalf(row, ADT_CELL_SIZE + 1, liquidHeader.liquidLevel, half);
+                    AppendData(output, half, sizeof(half));
+                }
+                else
+                {
+                    AppendData(output, row, sizeof(float) * (ADT_CELL_SIZE + 1));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Converts a loaded ADT into the contents of a .map file
+ *
+ * @param ctx
+ * @param adt
+ * @param filename name of the ADT, used for error messages
+ * @param build
+ * @param output receives the .map file contents
+ * @return bool
+ */
+bool ConvertADT(ConvertContext& ctx, ADT_file& adt, char const* filename, uint32 build, std::vector<char>& output)
+{
+    uint16 (&area_flags)[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID] = ctx.area_flags;
+    float (&V8)[ADT_GRID_SIZE][ADT_GRID_SIZE] = ctx.V8;
+    float (&V9)[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1] = ctx.V9;
+    uint16 (&uint16_V8)[ADT_GRID_SIZE][ADT_GRID_SIZE] = ctx.uint16_V8;
+    uint16 (&uint16_V9)[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1] = ctx.uint16_V9;
+    uint8 (&uint8_V8)[ADT_GRID_SIZE][ADT_GRID_SIZE] = ctx.uint8_V8;
+    uint8 (&uint8_V9)[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1] = ctx.uint8_V9;
+    uint16 (&liquid_entry)[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID] = ctx.liquid_entry;
+    uint8 (&liquid_flags)[ADT_CELLS_PER_GRID][ADT_CELLS_PER_GRID] = ctx.liquid_flags;
+    bool (&liquid_show)[ADT_GRID_SIZE][ADT_GRID_SIZE] = ctx.liquid_show;
+    float (&liquid_height)[ADT_GRID_SIZE + 1][ADT_GRID_SIZE + 1] = ctx.liquid_height;
+
+    adt_MCIN* cells = adt.a_grid->getMCIN();
+    if (!cells)
+    {
+        printf("Can not find cells in '%s'\n", filename);
+        return false;
+    }
+
+    memset(liquid_show, 0, sizeof(liquid_show));
+    memset(liquid_flags, 0, sizeof(liquid_flags));
+    memset(liquid_entry, 0, sizeof(liquid_entry));
+
+    // the last row and column are only written where this tile has liquid,
+    // the context is reused so nothing may be left from the tile before
+    for (int y = 0; y <= ADT_GRID_SIZE; ++y)
+    {
+        for (int x = 0; x <= ADT_GRID_SIZE; ++x)
+        {
+            liquid_height[y][x] = CONF_use_minHeight;
+        }
+    }
+
+    // Prepare map header
+    map_fileheader map;
+    map.mapMagic = *(uint32 const*)MAP_MAGIC;
+    map.versionMagic = *(uint32 const*)MAP_VERSION_MAGIC;
+    map.buildMagic = build;
+
+    // Get area flags data
+    for (int i = 0; i < ADT_CELLS_PER_GRID; i++)
+    {
+        for (int j = 0; j < ADT_CELLS_PER_GRID; j++)
+        {
+            adt_MCNK* cell = cells->getMCNK(i, j);
+            uint32 areaid = cell->areaid;
+            if (areaid && areaid <= maxAreaId)
+            {
+                if (areas[areaid] != 0xffff)
+                {
+                    area_flags[i][j] = areas[areaid];
+                    continue;
+                }
+                printf("File: %s\nCan not find area flag for area %u [%d, %d].\n", filename, areaid, cell->ix, cell->iy);
+            }
+            area_flags[i][j] = 0xffff;
+        }
+    }
+    //============================================
+    // Try pack area data
+    //============================================
+    bool fullAreaData = false;
+    uint32 areaflag = area_flags[0][0];
+    for (int y = 0; y < ADT_CELLS_PER_GRID; y++)
+    {
+        for (int x = 0; x < ADT_CELLS_PER_GRID; x++)
+        {
+            if (area_flags[y][x] != areaflag)
+            {
+                fullAreaData = true;
+                break;
+            }
+        }
+    }
+
+    map.areaMapOffset = sizeof(map);
+    map.areaMapSize   = sizeof(map_areaHeader);
+
+    map_areaHeader areaHeader;
+    areaHeader.fourcc = *(uint32 const*)MAP_AREA_MAGIC;
+    areaHeader.flags = 0;
+    if (fullAreaData)
+    {
+        areaHeader.gridArea = 0;
+        map.areaMapSize += sizeof(area_flags);
+    }
+    else
+    {
+        areaHeader.flags |= MAP_AREA_NO_AREA;
+        areaHeader.gridArea = (uint16)areaflag;
+    }
+
+    //
+    // Get Height map from grid
+    //
+    for (int i = 0; i < ADT_CELLS_PER_GRID; i++)
     {
         for (int j = 0; j < ADT_CELLS_PER_GRID; j++)
         {
@@ -606,61 +1166,11 @@ bool ConvertADT(char* filename, char* filename2, uint32 build)
     //============================================
     float maxHeight = -20000;
     float minHeight =  20000;
-    for (int y = 0; y < ADT_GRID_SIZE; y++)
-    {
-        for (int x = 0; x < ADT_GRID_SIZE; x++)
-        {
-            float h = V8[y][x];
-            if (maxHeight < h)
-            {
-                maxHeight = h;
-            }
-            if (minHeight > h)
-            {
-                minHeight = h;
-            }
-        }
-    }
-    for (int y = 0; y <= ADT_GRID_SIZE; y++)
-    {
-        for (int x = 0; x <= ADT_GRID_SIZE; x++)
-        {
-            float h = V9[y][x];
-            if (maxHeight < h)
-            {
-                maxHeight = h;
-            }
-            if (minHeight > h)
-            {
-                minHeight = h;
-            }
-        }
-    }
 
     // Check for allow limit minimum height (not store height in deep ochean - allow save some memory)
-    if (CONF_allow_height_limit && minHeight < CONF_use_minHeight)
-    {
-        for (int y = 0; y < ADT_GRID_SIZE; y++)
-            for (int x = 0; x < ADT_GRID_SIZE; x++)
-                if (V8[y][x] < CONF_use_minHeight)
-                {
-                    V8[y][x] = CONF_use_minHeight;
-                }
-        for (int y = 0; y <= ADT_GRID_SIZE; y++)
-            for (int x = 0; x <= ADT_GRID_SIZE; x++)
-                if (V9[y][x] < CONF_use_minHeight)
-                {
-                    V9[y][x] = CONF_use_minHeight;
-                }
-        if (minHeight < CONF_use_minHeight)
-        {
-            minHeight = CONF_use_minHeight;
-        }
-        if (maxHeight < CONF_use_minHeight)
-        {
-            maxHeight = CONF_use_minHeight;
-        }
-    }
+    // The clamp is done in the same pass as the min/max search
+    HeightClampMinMax(&V8[0][0], ADT_GRID_SIZE * ADT_GRID_SIZE, CONF_allow_height_limit, CONF_use_minHeight, minHeight, maxHeight);
+    HeightClampMinMax(&V9[0][0], (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1), CONF_allow_height_limit, CONF_use_minHeight, minHeight, maxHeight);
 
     map.heightMapOffset = map.areaMapOffset + map.areaMapSize;
     map.heightMapSize = sizeof(map_heightHeader);
@@ -690,45 +1200,87 @@ bool ConvertADT(char* filename, char* filename2, uint32 build)
         if (CONF_allow_float_to_int)
         {
             float diff = maxHeight - minHeight;
+            // with per cell ranges the same accuracy limits hold for each cell
+            float cellDiff = CONF_cell_packing ? GetCellHeightRanges(ctx) : diff;
             if (diff < CONF_float_to_int8_limit)      // As uint8 (max accuracy = CONF_float_to_int8_limit/256)
             {
                 heightHeader.flags |= MAP_HEIGHT_AS_INT8;
                 step = selectUInt8StepStore(diff);
             }
+            else if (cellDiff < CONF_float_to_int8_limit)
+            {
+                heightHeader.flags |= MAP_HEIGHT_AS_INT8 | MAP_HEIGHT_CELL_PACKED;
+            }
             else if (diff < CONF_float_to_int16_limit) // As uint16 (max accuracy = CONF_float_to_int16_limit/65536)
             {
                 heightHeader.flags |= MAP_HEIGHT_AS_INT16;
                 step = selectUInt16StepStore(diff);
             }
+            else if (cellDiff < CONF_float_to_int16_limit)
+            {
+                heightHeader.flags |= MAP_HEIGHT_AS_INT16 | MAP_HEIGHT_CELL_PACKED;
+            }
+        }
+
+        // Heights which would be stored as floats can still be halved,
+        // without the range limit of the int packing
+        if (CONF_float16 && !(heightHeader.flags & (MAP_HEIGHT_AS_INT8 | MAP_HEIGHT_AS_INT16)))
+        {
+            heightHeader.flags |= MAP_HEIGHT_AS_FLOAT16;
         }
 
         // Pack it to int values if need
-        if (heightHeader.flags & MAP_HEIGHT_AS_INT8)
+        if (heightHeader.flags & MAP_HEIGHT_CELL_PACKED)
         {
-            for (int y = 0; y < ADT_GRID_SIZE; y++)
-                for (int x = 0; x < ADT_GRID_SIZE; x++)
-                {
-                    uint8_V8[y][x] = uint8((V8[y][x] - minHeight) * step + 0.5f);
-                }
-            for (int y = 0; y <= ADT_GRID_SIZE; y++)
-                for (int x = 0; x <= ADT_GRID_SIZE; x++)
+            bool asInt8 = (heightHeader.flags & MAP_HEIGHT_AS_INT8) != 0;
+            for (int y = 0; y < ADT_CELLS_PER_GRID; ++y)
+            {
+                for (int x = 0; x < ADT_CELLS_PER_GRID; ++x)
                 {
-                    uint8_V9[y][x] = uint8((V9[y][x] - minHeight) * step + 0.5f);
+                    float diff = ctx.cell_maxHeight[y][x] - ctx.cell_minHeight[y][x];
+                    if (diff <= 0.0f)
+                    {
+                        ctx.cell_step[y][x] = 0.0f;
+                    }
+                    else
+                    {
+                        ctx.cell_step[y][x] = asInt8 ? selectUInt8StepStore(diff) : selectUInt16StepStore(diff);
+                    }
                 }
+            }
+
+            map.heightMapSize += sizeof(ctx.cell_minHeight) + sizeof(ctx.cell_maxHeight);
+            if (asInt8)
+            {
+                QuantizeCellHeights(&V8[0][0], &uint8_V8[0][0], ADT_GRID_SIZE, ctx);
+                QuantizeCellHeights(&V9[0][0], &uint8_V9[0][0], ADT_GRID_SIZE + 1, ctx);
+                map.heightMapSize += sizeof(uint8_V9) + sizeof(uint8_V8);
+            }
+            else
+            {
+                QuantizeCellHeights(&V8[0][0], &uint16_V8[0][0], ADT_GRID_SIZE, ctx);
+                QuantizeCellHeights(&V9[0][0], &uint16_V9[0][0], ADT_GRID_SIZE + 1, ctx);
+                map.heightMapSize += sizeof(uint16_V9) + sizeof(uint16_V8);
+            }
+        }
+        else if (heightHeader.flags & MAP_HEIGHT_AS_INT8)
+        {
+            HeightQuantizeUInt8(&V8[0][0], ADT_GRID_SIZE * ADT_GRID_SIZE, minHeight, step, &uint8_V8[0][0]);
+            HeightQuantizeUInt8(&V9[0][0], (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1), minHeight, step, &uint8_V9[0][0]);
             map.heightMapSize += sizeof(uint8_V9) + sizeof(uint8_V8);
         }
         else if (heightHeader.flags & MAP_HEIGHT_AS_INT16)
         {
-            for (int y = 0; y < ADT_GRID_SIZE; y++)
-                for (int x = 0; x < ADT_GRID_SIZE; x++)
-                {
-                    uint16_V8[y][x] = uint16((V8[y][x] - minHeight) * step + 0.5f);
-                }
-            for (int y = 0; y <= ADT_GRID_SIZE; y++)
-                for (int x = 0; x <= ADT_GRID_SIZE; x++)
-                {
-                    uint16_V9[y][x] = uint16((V9[y][x] - minHeight) * step + 0.5f);
-                }
+            HeightQuantizeUInt16(&V8[0][0], ADT_GRID_SIZE * ADT_GRID_SIZE, minHeight, step, &uint16_V8[0][0]);
+            HeightQuantizeUInt16(&V9[0][0], (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1), minHeight, step, &uint16_V9[0][0]);
+            map.heightMapSize += sizeof(uint16_V9) + sizeof(uint16_V8);
+        }
+        else if (heightHeader.flags & MAP_HEIGHT_AS_FLOAT16)
+        {
+            // relative to the middle of the range, the error grows with the magnitude
+            float base = (minHeight + maxHeight) * 0.5f;
+            HeightToHalf(&V8[0][0], ADT_GRID_SIZE * ADT_GRID_SIZE, base, &uint16_V8[0][0]);
+            HeightToHalf(&V9[0][0], (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1), base, &uint16_V9[0][0]);
             map.heightMapSize += sizeof(uint16_V9) + sizeof(uint16_V8);
         }
         else
@@ -995,7 +1547,35 @@ bool ConvertADT(char* filename, char* filename2, uint32 build)
 
         if (!(liquidHeader.flags & MAP_LIQUID_NO_HEIGHT))
         {
-            map.liquidMapSize += sizeof(float) * liquidHeader.width * liquidHeader.height;
+            size_t heightSize = sizeof(float);
+            if (CONF_float16)
+            {
+                liquidHeader.flags |= MAP_LIQUID_HEIGHT_AS_FLOAT16;
+                heightSize = sizeof(uint16);
+            }
+
+            // Small pools far apart make the bounding box cover most of the tile,
+            // then only the cells with liquid are stored
+            uint32 liquidCells = CONF_sparse_liquid ? GetLiquidCells(ctx) : 0;
+            size_t boxSize = heightSize * liquidHeader.width * liquidHeader.height;
+            size_t sparseSize = sizeof(ctx.liquid_cells) + liquidCells * (sizeof(uint64) + heightSize * (ADT_CELL_SIZE + 1) * (ADT_CELL_SIZE + 1));
+            if (CONF_sparse_liquid && sparseSize < boxSize)
+            {
+                liquidHeader.flags |= MAP_LIQUID_SPARSE;
+                map.liquidMapSize += sparseSize;
+            }
+            else
+            {
+                if (CONF_float16)
+                {
+                    for (int y = 0; y < liquidHeader.height; y++)
+                    {
+                        LiquidHeightToHalf(&liquid_height[y + liquidHeader.offsetY][liquidHeader.offsetX], liquidHeader.width,
+                                           liquidHeader.liquidLevel, &ctx.liquid_height_half[y][0]);
+                    }
+                }
+                map.liquidMapSize += boxSize;
+            }
         }
     }
 
@@ -1028,92 +1608,884 @@ bool ConvertADT(char* filename, char* filename2, uint32 build)
     }
 
     // Ok all data prepared - store it
-    FILE* output = fopen(filename2, "wb");
-    if (!output)
-    {
-        printf("Can not create the output file '%s'\n", filename2);
-        return false;
-    }
-    fwrite(&map, sizeof(map), 1, output);
+    output.clear();
+    AppendData(output, &map, sizeof(map));
     // Store area data
-    fwrite(&areaHeader, sizeof(areaHeader), 1, output);
+    AppendData(output, &areaHeader, sizeof(areaHeader));
     if (!(areaHeader.flags & MAP_AREA_NO_AREA))
     {
-        fwrite(area_flags, sizeof(area_flags), 1, output);
+        AppendData(output, area_flags, sizeof(area_flags));
     }
 
     // Store height data
-    fwrite(&heightHeader, sizeof(heightHeader), 1, output);
+    AppendData(output, &heightHeader, sizeof(heightHeader));
     if (!(heightHeader.flags & MAP_HEIGHT_NO_HEIGHT))
     {
-        if (heightHeader.flags & MAP_HEIGHT_AS_INT16)
+        if (heightHeader.flags & MAP_HEIGHT_CELL_PACKED)
         {
-            fwrite(uint16_V9, sizeof(uint16_V9), 1, output);
-            fwrite(uint16_V8, sizeof(uint16_V8), 1, output);
+            AppendData(output, ctx.cell_minHeight, sizeof(ctx.cell_minHeight));
+            AppendData(output, ctx.cell_maxHeight, sizeof(ctx.cell_maxHeight));
+        }
+        if (heightHeader.flags & (MAP_HEIGHT_AS_INT16 | MAP_HEIGHT_AS_FLOAT16))
+        {
+            AppendData(output, uint16_V9, sizeof(uint16_V9));
+            AppendData(output, uint16_V8, sizeof(uint16_V8));
         }
         else if (heightHeader.flags & MAP_HEIGHT_AS_INT8)
         {
-            fwrite(uint8_V9, sizeof(uint8_V9), 1, output);
-            fwrite(uint8_V8, sizeof(uint8_V8), 1, output);
+            AppendData(output, uint8_V9, sizeof(uint8_V9));
+            AppendData(output, uint8_V8, sizeof(uint8_V8));
         }
         else
         {
-            fwrite(V9, sizeof(V9), 1, output);
-            fwrite(V8, sizeof(V8), 1, output);
+            AppendData(output, V9, sizeof(V9));
+            AppendData(output, V8, sizeof(V8));
         }
     }
 
     // Store liquid data if need
     if (map.liquidMapOffset)
     {
-        fwrite(&liquidHeader, sizeof(liquidHeader), 1, output);
+        AppendData(output, &liquidHeader, sizeof(liquidHeader));
         if (!(liquidHeader.flags & MAP_LIQUID_NO_TYPE))
         {
-            fwrite(liquid_entry, sizeof(liquid_entry), 1, output);
-            fwrite(liquid_flags, sizeof(liquid_flags), 1, output);
+            AppendData(output, liquid_entry, sizeof(liquid_entry));
+            AppendData(output, liquid_flags, sizeof(liquid_flags));
         }
-        if (!(liquidHeader.flags & MAP_LIQUID_NO_HEIGHT))
+        if (liquidHeader.flags & MAP_LIQUID_SPARSE)
+        {
+            AppendLiquidCells(output, ctx, liquidHeader);
+        }
+        else if (liquidHeader.flags & MAP_LIQUID_HEIGHT_AS_FLOAT16)
+        {
+            for (int y = 0; y < liquidHeader.height; y++)
+            {
+                AppendData(output, &ctx.liquid_height_half[y][0], sizeof(uint16) * liquidHeader.width);
+            }
+        }
+        else if (!(liquidHeader.flags & MAP_LIQUID_NO_HEIGHT))
         {
             for (int y = 0; y < liquidHeader.height; y++)
             {
-                fwrite(&liquid_height[y + liquidHeader.offsetY][liquidHeader.offsetX], sizeof(float), liquidHeader.width, output);
+                AppendData(output, &liquid_height[y + liquidHeader.offsetY][liquidHeader.offsetX], sizeof(float) * liquidHeader.width);
             }
         }
     }
 
     // store hole data
-    fwrite(holes, map.holesSize, 1, output);
-
-    fclose(output);
+    AppendData(output, holes, map.holesSize);
 
     return true;
 }
 
 /**
- * @brief
+ * @brief Writes a converted .map file to disk
  *
+ * @param filename
+ * @param data
+ * @return bool
  */
-void ExtractMapsFromMpq(uint32 build)
+bool WriteMapFile(char const* filename, std::vector<char> const& data)
 {
-    char mpq_filename[1024];
-    char output_filename[1024];
-    char mpq_map_name[1024];
+    FILE* output = fopen(filename, "wb");
+    if (!output)
+    {
+        printf("Can not create the output file '%s'\n", filename);
+        return false;
+    }
 
-    printf("\n Extracting maps...\n");
+    if (!data.empty())
+    {
+        fwrite(&data[0], data.size(), 1, output);
+    }
+    fclose(output);
+    return true;
+}
 
-    uint32 map_count = ReadMapDBC();
+/**
+ * @brief A single ADT tile which has to be converted
+ *
+ */
+struct MapTile
+{
+    uint32 mapIndex;                /**< index into map_ids */
+    uint32 x;                       /**< TODO */
+    uint32 y;                       /**< TODO */
+};
 
-    ReadAreaTableDBC();
-    ReadLiquidTypeTableDBC();
+/**
+ * @brief Data shared by everything converting the tiles of one run
+ *
+ */
+struct MapConvertRun
+{
+    uint32 map_count;               /**< TODO */
+    uint32 build;                   /**< TODO */
+    uint64 settingsHash;            /**< see GetConversionSettingsHash */
+    MapManifest previous;           /**< manifest of the last run, only read while converting */
+    MapManifest current;            /**< manifest of this run, only updated by the tile store */
+    uint32 readFiles;               /**< ADTs loaded, only updated by the reading thread */
+    uint64 readBytes;               /**< decompressed size of the loaded ADTs */
+    double readSeconds;             /**< time spent loading them */
+};
 
-    std::string path = output_path;
-    path += "/maps/";
-    CreateDir(path);
+/**
+ * @brief Hashes everything besides the ADT itself which ends up in a .map
+ *        file: format version, conversion settings and the DBC tables used
+ *
+ * @return uint64
+ */
+uint64 GetConversionSettingsHash()
+{
+    uint64 hash = hashBytes(MAP_VERSION_MAGIC, strlen(MAP_VERSION_MAGIC));
+    hash = hashBytes(&CONF_allow_height_limit, sizeof(CONF_allow_height_limit), hash);
+    hash = hashBytes(&CONF_use_minHeight, sizeof(CONF_use_minHeight), hash);
+    hash = hashBytes(&CONF_allow_float_to_int, sizeof(CONF_allow_float_to_int), hash);
+    hash = hashBytes(&CONF_float_to_int8_limit, sizeof(CONF_float_to_int8_limit), hash);
+    hash = hashBytes(&CONF_float_to_int16_limit, sizeof(CONF_float_to_int16_limit), hash);
+    hash = hashBytes(&CONF_flat_height_delta_limit, sizeof(CONF_flat_height_delta_limit), hash);
+    hash = hashBytes(&CONF_flat_liquid_delta_limit, sizeof(CONF_flat_liquid_delta_limit), hash);
+    hash = hashBytes(&CONF_cell_packing, sizeof(CONF_cell_packing), hash);
+    hash = hashBytes(&CONF_float16, sizeof(CONF_float16), hash);
+    hash = hashBytes(&CONF_sparse_liquid, sizeof(CONF_sparse_liquid), hash);
+
+    int liquidTypes[5] = { MAP_LIQUID_TYPE_NO_WATER, MAP_LIQUID_TYPE_MAGMA, MAP_LIQUID_TYPE_OCEAN, MAP_LIQUID_TYPE_SLIME, MAP_LIQUID_TYPE_WATER };
+    hash = hashBytes(liquidTypes, sizeof(liquidTypes), hash);
+
+    hash = hashBytes(areas, (maxAreaId + 1) * sizeof(uint16), hash);
+    hash = hashBytes(LiqType, (maxLiquidTypeId + 1) * sizeof(uint16), hash);
+    return hash;
+}
 
-    printf("\n Converting map files\n");
+/**
+ * @brief Builds the archive and output names of a tile
+ *
+ * @param tile
+ * @param mpq_filename
+ * @param output_filename
+ */
+void GetMapTileNames(MapTile const& tile, char* mpq_filename, char* output_filename)
+{
+    map_id const& map = map_ids[tile.mapIndex];
+    sprintf(mpq_filename, "World\\Maps\\%s\\%s_%u_%u.adt", map.name, map.name, tile.x, tile.y);
+    sprintf(output_filename, "%s/maps/%03u%02u%02u.map", output_path, map.id, tile.y, tile.x);
+}
+
+/**
+ * @brief Prints the map header line when the conversion moves on to a new map
+ *
+ * @param tile
+ * @param lastMap
+ * @param map_count
+ */
+void ReportMapTile(MapTile const& tile, int& lastMap, uint32 map_count)
+{
+    if (int(tile.mapIndex) != lastMap)
+    {
+        lastMap = int(tile.mapIndex);
+        printf(" Extract %s (%d/%d)                      \n", map_ids[tile.mapIndex].name, tile.mapIndex + 1, map_count);
+    }
+}
+
+/**
+ * @brief Checks a tile against the --map and --tile selection
+ *
+ * @param mapId
+ * @param x
+ * @param y
+ * @return bool
+ */
+bool IsMapTileSelected(uint32 mapId, uint32 x, uint32 y)
+{
+    if (!CONF_maps.empty() && CONF_maps.find(mapId) == CONF_maps.end())
+    {
+        return false;
+    }
+    return CONF_tiles.empty() || CONF_tiles.find(std::pair<uint32, uint32>(x, y)) != CONF_tiles.end();
+}
+
+/**
+ * @brief Position of a tile's ADT in the archives
+ *
+ */
+struct MapTileLocation
+{
+    uint32 archive;                 /**< index into gOpenArchives, its size if the file was not found */
+    uint64 offset;                  /**< offset of the file in its archive */
+    uint64 packedSize;              /**< compressed size of the file in its archive */
+    MapTile tile;                   /**< TODO */
+};
+
+/**
+ * @brief Finds the ADT of a tile the way MPQFile does, in the first archive
+ *        holding it, without reading the file
+ *
+ * @param tile
+ * @param location
+ * @return bool false if no archive holds the file
+ */
+bool LocateMapTile(MapTile const& tile, MapTileLocation& location)
+{
+    char mpq_filename[1024];
+    char output_filename[1024];
+    GetMapTileNames(tile, mpq_filename, output_filename);
+
+    location.tile = tile;
+    location.archive = uint32(gOpenArchives.size());
+    location.offset = 0;
+    location.packedSize = 0;
+
+    MPQFileIndexEntry const* entry = gFileIndex.find(mpq_filename);
+    if (entry)
+    {
+        location.archive = entry->archive;
+        location.offset = entry->offset;
+        location.packedSize = entry->packedSize;
+        return true;
+    }
+
+    // the index only knows the files of the listfiles, ask the archives
+    // directly for an ADT missing from them
+    uint32 archive = 0;
+    for (ArchiveSet::const_iterator itr = gOpenArchives.begin(); itr != gOpenArchives.end(); ++itr, ++archive)
+    {
+        uint32_t filenum;
+        if (libmpq__file_number((*itr)->mpq_a, mpq_filename, &filenum))
+        {
+            continue;
+        }
+
+        libmpq__off_t offset = 0;
+        libmpq__off_t packedSize = 0;
+        libmpq__file_offset((*itr)->mpq_a, filenum, &offset);
+        libmpq__file_packed_size((*itr)->mpq_a, filenum, &packedSize);
+        location.archive = archive;
+        location.offset = uint64(offset);
+        location.packedSize = uint64(packedSize);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief
+ *
+ * @param a
+ * @param b
+ * @return bool
+ */
+bool CompareMapTileLocation(MapTileLocation const& a, MapTileLocation const& b)
+{
+    if (a.archive != b.archive)
+    {
+        return a.archive < b.archive;
+    }
+    return a.offset < b.offset;
+}
+
+/**
+ * @brief Sorts the tiles into the order their ADTs are stored in the archives
+ *
+ * Each ADT is looked up the way MPQFile does, in the first archive holding
+ * it. Reading in this order keeps the disk access sequential instead of
+ * jumping through terrain.MPQ and the patches map by map. Tiles whose
+ * file was not found go last.
+ *
+ * @param tiles
+ */
+void SortMapTilesByArchiveOffset(std::vector<MapTile>& tiles)
+{
+    std::vector<MapTileLocation> locations(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        LocateMapTile(tiles[i], locations[i]);
+    }
+
+    // stable, so tiles at the same place keep the map order
+    std::stable_sort(locations.begin(), locations.end(), CompareMapTileLocation);
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        tiles[i] = locations[i].tile;
+    }
+}
+
+/**
+ * @brief Lists the ADTs which would be converted with their compressed
+ *        size, per map and in total, in the order they would be read
+ *
+ * @param tiles
+ * @param map_count
+ */
+void PrintMapExtractionPlan(std::vector<MapTile> const& tiles, uint32 map_count)
+{
+    std::vector<uint32> mapTiles(map_count, 0);
+    std::vector<uint64> mapBytes(map_count, 0);
+    uint64 totalBytes = 0;
+    uint32 missing = 0;
+
+    printf("\n Extraction plan\n");
+    printf("   %-4s %-32s %-6s %-8s %12s\n", "map", "name", "tile", "archive", "bytes");
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        MapTileLocation location;
+        map_id const& map = map_ids[tiles[i].mapIndex];
+        if (!LocateMapTile(tiles[i], location))
+        {
+            printf("   %03u  %-32s %02u,%02u  missing\n", map.id, map.name, tiles[i].x, tiles[i].y);
+            ++missing;
+            continue;
+        }
+
+        printf("   %03u  %-32s %02u,%02u  %-8u %12llu\n", map.id, map.name, tiles[i].x, tiles[i].y,
+               location.archive, (unsigned long long)location.packedSize);
+        ++mapTiles[tiles[i].mapIndex];
+        mapBytes[tiles[i].mapIndex] += location.packedSize;
+        totalBytes += location.packedSize;
+    }
+
+    printf("\n Per map\n");
+    for (uint32 i = 0; i < map_count; ++i)
+    {
+        if (mapTiles[i])
+        {
+            printf("   %03u  %-32s %5u tiles %10.1f MB\n", map_ids[i].id, map_ids[i].name, mapTiles[i], mapBytes[i] / 1048576.0);
+        }
+    }
+
+    printf("\n %u tiles to convert, %.1f MB of compressed ADT data", uint32(tiles.size()) - missing, totalBytes / 1048576.0);
+    if (missing)
+    {
+        printf(", %u listed in a WDT but not found", missing);
+    }
+    printf("\n");
+    if (CONF_incremental)
+    {
+        printf(" Tiles unchanged since the last run are only known after reading them and are included above\n");
+    }
+}
+
+/**
+ * @brief Loads the ADT of a tile and adds it to the read statistics of the run
+ *
+ * @param adt
+ * @param mpq_filename
+ * @param run
+ * @return bool
+ */
+bool LoadMapTileADT(ADT_file& adt, char* mpq_filename, MapConvertRun& run)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool loaded = adt.loadFile(mpq_filename);
+    run.readSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (loaded)
+    {
+        ++run.readFiles;
+        run.readBytes += adt.GetDataSize();
+    }
+    return loaded;
+}
+
+/**
+ * @brief Checks whether a tile can be kept from the last run
+ *
+ * @param tile
+ * @param sourceHash hash of the loaded ADT
+ * @param run
+ * @return bool
+ */
+bool IsMapTileUnchanged(MapTile const& tile, uint64 sourceHash, MapConvertRun const& run)
+{
+    if (!CONF_incremental)
+    {
+        return false;
+    }
+
+    MapManifestEntry const* entry = run.previous.find(map_ids[tile.mapIndex].id, tile.x, tile.y);
+    if (!entry || entry->sourceHash != sourceHash || entry->build != run.build || entry->settingsHash != run.settingsHash)
+    {
+        return false;
+    }
+
+    // the output may have been removed by hand
+    char mpq_filename[1024];
+    char output_filename[1024];
+    GetMapTileNames(tile, mpq_filename, output_filename);
+    return ClientFileExists(output_filename);
+}
+
+/**
+ * @brief Stores converted tiles, either as loose .map files or in one packed
+ *        file per map, and records them in the manifest of the run
+ *
+ * Every tile has to be handed in exactly once, also when it could not be
+ * converted, so a packed file is completed as soon as its map is done.
+ */
+class MapTileStore
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param tiles all tiles which are going to be stored
+         * @param run
+         */
+        MapTileStore(std::vector<MapTile> const& tiles, MapConvertRun& run) :
+            m_run(run), m_remaining(run.map_count, 0), m_converted(0), m_unchanged(0)
+        {
+            for (size_t i = 0; i < tiles.size(); ++i)
+            {
+                ++m_remaining[tiles[i].mapIndex];
+            }
+        }
+
+        /**
+         * @brief Completes all packed files still open
+         *
+         */
+        ~MapTileStore()
+        {
+            for (std::map<uint32, PackedMapWriter*>::iterator itr = m_packed.begin(); itr != m_packed.end(); ++itr)
+            {
+                delete itr->second;
+            }
+
+            if (CONF_incremental)
+            {
+                printf("\n %u tiles converted, %u unchanged\n", m_converted, m_unchanged);
+            }
+        }
+
+        /**
+         * @brief
+         *
+         * @param tile
+         * @param data .map contents, NULL if the tile was not converted
+         * @param sourceHash hash of the ADT the tile was loaded from
+         * @param unchanged the output of the last run is kept
+         */
+        void store(MapTile const& tile, std::vector<char> const* data, uint64 sourceHash, bool unchanged)
+        {
+            if (data || unchanged)
+            {
+                MapManifestEntry entry;
+                entry.mapId = map_ids[tile.mapIndex].id;
+                entry.x = tile.x;
+                entry.y = tile.y;
+                entry.sourceHash = sourceHash;
+                entry.build = m_run.build;
+                entry.settingsHash = m_run.settingsHash;
+                m_run.current.set(entry);
+                ++(unchanged ? m_unchanged : m_converted);
+            }
+
+            if (!CONF_packed)
+            {
+                char mpq_filename[1024];
+                char output_filename[1024];
+                GetMapTileNames(tile, mpq_filename, output_filename);
+                if (data)
+                {
+                    WriteMapFile(output_filename, *data);
+                }
+                else if (CONF_incremental && !unchanged)
+                {
+                    // do not leave the output of an older run behind
+                    remove(output_filename);
+                }
+                return;
+            }
+
+            if (data && !data->empty())
+            {
+                PackedMapWriter*& writer = m_packed[tile.mapIndex];
+                if (!writer)
+                {
+                    char packed_filename[1024];
+                    sprintf(packed_filename, "%s/maps/%03u.pmap", output_path, map_ids[tile.mapIndex].id);
+                    writer = new PackedMapWriter;
+                    writer->create(packed_filename, map_ids[tile.mapIndex].id, *(uint32 const*)MAP_VERSION_MAGIC, m_run.build);
+                }
+                writer->addTile(tile.x, tile.y, &(*data)[0], uint32(data->size()));
+
+                // the mmap generator reads a loose tile instead when it is not older
+                char mpq_filename[1024];
+                char output_filename[1024];
+                GetMapTileNames(tile, mpq_filename, output_filename);
+                remove(output_filename);
+            }
+
+            if (--m_remaining[tile.mapIndex] == 0)
+            {
+                std::map<uint32, PackedMapWriter*>::iterator itr = m_packed.find(tile.mapIndex);
+                if (itr != m_packed.end())
+                {
+                    delete itr->second;
+                    m_packed.erase(itr);
+                }
+            }
+        }
+
+    private:
+        MapConvertRun& m_run;                               /**< TODO */
+        std::vector<uint32> m_remaining;                    /**< tiles not yet stored, per map index */
+        std::map<uint32, PackedMapWriter*> m_packed;        /**< open packed files, per map index */
+        uint32 m_converted;                                 /**< TODO */
+        uint32 m_unchanged;                                 /**< TODO */
+};
+
+/**
+ * @brief Converts all tiles one after the other on the calling thread
+ *
+ * @param tiles
+ * @param run
+ */
+void ConvertMapTilesSerial(std::vector<MapTile> const& tiles, MapConvertRun& run)
+{
+    char mpq_filename[1024];
+    char output_filename[1024];
+    ConvertContext* ctx = new ConvertContext();
+    MapTileStore tileStore(tiles, run);
+    std::vector<char> data;
+    int lastMap = -1;
+
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        ReportMapTile(tiles[i], lastMap, run.map_count);
+        GetMapTileNames(tiles[i], mpq_filename, output_filename);
+
+        ADT_file adt;
+        bool converted = false;
+        bool unchanged = false;
+        uint64 sourceHash = 0;
+        if (LoadMapTileADT(adt, mpq_filename, run))
+        {
+            sourceHash = hashBytes(adt.GetData(), adt.GetDataSize());
+            unchanged = IsMapTileUnchanged(tiles[i], sourceHash, run);
+            converted = !unchanged && ConvertADT(*ctx, adt, mpq_filename, run.build, data);
+        }
+        tileStore.store(tiles[i], converted ? &data : NULL, sourceHash, unchanged);
+
+        // draw progress bar
+        printf(" Processing........................%d%%\r", int((100 * (i + 1)) / tiles.size()));
+    }
+
+    delete ctx;
+}
+
+/**
+ * @brief A tile travelling through the conversion pipeline
+ *
+ */
+struct MapTileTask
+{
+    MapTile const* tile;            /**< TODO */
+    ADT_file* adt;                  /**< loaded by the read stage, released after conversion, NULL if loading failed */
+    uint64 sourceHash;              /**< hash of the loaded ADT */
+    bool unchanged;                 /**< the output of the last run is kept, nothing to convert */
+    std::vector<char> data;         /**< .map contents produced by the convert stage, empty if conversion failed */
+};
+
+/**
+ * @brief State shared by the read, convert and write stages
+ *
+ * The read stage is the only one touching the archives, as the MPQ layer is
+ * not thread safe. Conversion runs on CONF_threads workers, each with its own
+ * ConvertContext, and a single writer stores the results.
+ */
+struct MapPipeline
+{
+    MapPipeline(std::vector<MapTile> const& t, MapConvertRun& r) :
+        tiles(t), run(r),
+        readQueue(CONF_read_queue), writeQueue(CONF_write_queue),
+        activeConverters(0), tileContents(NULL)
+    {
+    }
+
+    std::vector<MapTile> const& tiles;          /**< TODO */
+    MapConvertRun& run;                         /**< TODO */
+    BoundedQueue<MapTileTask*> readQueue;       /**< loaded ADTs waiting for conversion */
+    BoundedQueue<MapTileTask*> writeQueue;      /**< converted tiles waiting to be written */
+    std::atomic<int> activeConverters;          /**< the last converter to finish closes writeQueue */
+    std::vector<std::pair<uint64, size_t> >* tileContents; /**< hash and size of each tile instead of storing it, see CheckMapConvertThreads */
+};
+
+/**
+ * @brief Read stage, loads and decompresses the ADTs ahead of the converters
+ *
+ * @param pipeline
+ */
+void MapPipelineRead(MapPipeline* pipeline)
+{
+    char mpq_filename[1024];
+    char output_filename[1024];
+    int lastMap = -1;
+
+    for (size_t i = 0; i < pipeline->tiles.size(); ++i)
+    {
+        MapTile const& tile = pipeline->tiles[i];
+        ReportMapTile(tile, lastMap, pipeline->run.map_count);
+        GetMapTileNames(tile, mpq_filename, output_filename);
+
+        MapTileTask* task = new MapTileTask;
+        task->tile = &tile;
+        task->adt = new ADT_file;
+        task->sourceHash = 0;
+        task->unchanged = false;
+        bool loaded = LoadMapTileADT(*task->adt, mpq_filename, pipeline->run);
+        if (loaded)
+        {
+            task->sourceHash = hashBytes(task->adt->GetData(), task->adt->GetDataSize());
+            task->unchanged = IsMapTileUnchanged(tile, task->sourceHash, pipeline->run);
+        }
+
+        if (!loaded || task->unchanged)
+        {
+            // passed on anyway, the writer has to see every tile
+            delete task->adt;
+            task->adt = NULL;
+        }
+
+        pipeline->readQueue.push(task);
+    }
+
+    pipeline->readQueue.close();
+}
+
+/**
+ * @brief Convert stage, turns loaded ADTs into .map file contents
+ *
+ * @param pipeline
+ */
+void MapPipelineConvert(MapPipeline* pipeline)
+{
+    char mpq_filename[1024];
+    char output_filename[1024];
+    ConvertContext* ctx = new ConvertContext();
+    MapTileTask* task;
+
+    while (pipeline->readQueue.pop(task))
+    {
+        if (task->adt)
+        {
+            GetMapTileNames(*task->tile, mpq_filename, output_filename);
+            if (!ConvertADT(*ctx, *task->adt, mpq_filename, pipeline->run.build, task->data))
+            {
+                task->data.clear();
+            }
+            delete task->adt;
+            task->adt = NULL;
+        }
+
+        pipeline->writeQueue.push(task);
+    }
+
+    delete ctx;
+
+    if (--pipeline->activeConverters == 0)
+    {
+        pipeline->writeQueue.close();
+    }
+}
+
+/**
+ * @brief Write stage, stores the converted tiles
+ *
+ * @param pipeline
+ */
+void MapPipelineWrite(MapPipeline* pipeline)
+{
+    MapTileTask* task;
+    if (pipeline->tileContents)
+    {
+        while (pipeline->writeQueue.pop(task))
+        {
+            size_t size = task->data.size();
+            (*pipeline->tileContents)[task->tile - &pipeline->tiles[0]] =
+                std::make_pair(hashBytes(size ? &task->data[0] : NULL, size), size);
+            delete task;
+        }
+        return;
+    }
+
+    MapTileStore tileStore(pipeline->tiles, pipeline->run);
+    uint32 written = 0;
+
+    while (pipeline->writeQueue.pop(task))
+    {
+        tileStore.store(*task->tile, task->data.empty() ? NULL : &task->data, task->sourceHash, task->unchanged);
+        delete task;
+
+        // draw progress bar
+        printf(" Processing........................%d%%\r", int((100 * ++written) / pipeline->tiles.size()));
+    }
+}
+
+/**
+ * @brief Runs the read, convert and write stages until all tiles are done
+ *
+ * @param pipeline
+ * @param threads number of converters
+ */
+void RunMapPipeline(MapPipeline& pipeline, int threads)
+{
+    pipeline.activeConverters = threads;
+
+    std::thread reader(MapPipelineRead, &pipeline);
+    std::thread writer(MapPipelineWrite, &pipeline);
+    std::vector<std::thread> converters;
+    for (int i = 0; i < threads; ++i)
+    {
+        converters.push_back(std::thread(MapPipelineConvert, &pipeline));
+    }
+
+    reader.join();
+    for (size_t i = 0; i < converters.size(); ++i)
+    {
+        converters[i].join();
+    }
+    writer.join();
+}
+
+/**
+ * @brief Converts all tiles using the read -> convert -> write pipeline
+ *
+ * @param tiles
+ * @param run
+ */
+void ConvertMapTilesPipelined(std::vector<MapTile> const& tiles, MapConvertRun& run)
+{
+    MapPipeline pipeline(tiles, run);
+    RunMapPipeline(pipeline, CONF_threads);
+
+    printf("\n Pipeline stalls:\n");
+    printf("   read     %8.2fs waiting for the convert queue\n", pipeline.readQueue.pushWaitSeconds());
+    printf("   convert  %8.2fs waiting for input, %.2fs waiting for the write queue (sum of %d workers)\n",
+           pipeline.readQueue.popWaitSeconds(), pipeline.writeQueue.pushWaitSeconds(), CONF_threads);
+    printf("   write    %8.2fs waiting for input\n", pipeline.writeQueue.popWaitSeconds());
+}
+
+/**
+ * @brief Converts the tiles with one converter and again with several, and
+ *        compares the .map contents of every tile
+ *
+ * Converters reuse their context for whatever tile the queue hands them
+ * next, so anything a tile leaves in it shows up here as a difference.
+ * Nothing is written, the contents are compared by hash and size.
+ *
+ * @param tiles
+ * @param run
+ * @param threads converters of the second run
+ * @return bool false if any tile differed
+ */
+bool CheckMapConvertThreads(std::vector<MapTile> const& tiles, MapConvertRun& run, int threads)
+{
+    std::vector<std::pair<uint64, size_t> > contents[2];
+    int runThreads[2] = { 1, threads };
+    for (int i = 0; i < 2; ++i)
+    {
+        printf(" Converting %u tiles on %d thread(s)...\n", uint32(tiles.size()), runThreads[i]);
+        contents[i].resize(tiles.size());
+        MapPipeline pipeline(tiles, run);
+        pipeline.tileContents = &contents[i];
+        RunMapPipeline(pipeline, runThreads[i]);
+    }
+
+    uint32 mismatches = 0;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (contents[0][i] != contents[1][i])
+        {
+            printf(" Tile %02u,%02u of map %03u differs between 1 and %d threads\n",
+                   tiles[i].x, tiles[i].y, map_ids[tiles[i].mapIndex].id, threads);
+            ++mismatches;
+        }
+    }
+
+    printf(" %u tiles compared, %u mismatches\n", uint32(tiles.size()), mismatches);
+    return mismatches == 0;
+}
+
+/**
+ * @brief Removes the outputs of tiles listed in the last manifest which are
+ *        no longer part of the client data
+ *
+ * @param tiles
+ * @param run
+ */
+void RemoveStaleMapTiles(std::vector<MapTile> const& tiles, MapConvertRun const& run)
+{
+    std::set<uint64> existing;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        existing.insert(MapManifest::makeKey(map_ids[tiles[i].mapIndex].id, tiles[i].x, tiles[i].y));
+    }
+
+    uint32 removed = 0;
+    MapManifest::EntryMap const& entries = run.previous.getEntries();
+    for (MapManifest::EntryMap::const_iterator itr = entries.begin(); itr != entries.end(); ++itr)
+    {
+        if (existing.find(itr->first) != existing.end() || !IsMapTileSelected(itr->second.mapId, itr->second.x, itr->second.y))
+        {
+            continue;
+        }
+
+        char output_filename[1024];
+        sprintf(output_filename, "%s/maps/%03u%02u%02u.map", output_path, itr->second.mapId, itr->second.y, itr->second.x);
+        if (remove(output_filename) == 0)
+        {
+            ++removed;
+        }
+    }
+
+    if (removed)
+    {
+        printf(" Removed %u tiles which no longer exist\n", removed);
+    }
+}
+
+/**
+ * @brief
+ *
+ * @param build
+ * @return bool false if the --check-threads comparison found differences
+ */
+bool ExtractMapsFromMpq(uint32 build)
+{
+    char mpq_map_name[1024];
+
+    printf("\n Extracting maps...\n");
+
+    uint32 map_count = ReadMapDBC();
+
+    ReadAreaTableDBC();
+    ReadLiquidTypeTableDBC();
+
+    if (!CONF_tiles.empty() && CONF_packed)
+    {
+        printf(" --tile can not be used with --packed, the packed file of a map is always written as a whole\n");
+        delete [] areas;
+        delete [] map_ids;
+        return true;
+    }
+
+    if (!CONF_plan)
+    {
+        std::string path = output_path;
+        path += "/maps/";
+        CreateDir(path);
+
+        printf("\n Converting map files\n");
+        printf(" Height packing kernel: %s\n", GetHeightPackingKernelName(GetHeightPackingKernel()));
+    }
+
+    std::vector<MapTile> tiles;
     for (uint32 z = 0; z < map_count; ++z)
     {
-        printf(" Extract %s (%d/%d)                      \n", map_ids[z].name, z + 1, map_count);
+        if (!CONF_maps.empty() && CONF_maps.find(map_ids[z].id) == CONF_maps.end())
+        {
+            continue;
+        }
+
         // Loadup map grid data
         sprintf(mpq_map_name, "World\\Maps\\%s\\%s.wdt", map_ids[z].name, map_ids[z].name);
         WDT_file wdt;
@@ -1127,20 +2499,103 @@ void ExtractMapsFromMpq(uint32 build)
         {
             for (uint32 x = 0; x < WDT_MAP_SIZE; ++x)
             {
-                if (!wdt.main->adt_list[y][x].exist)
+                if (wdt.main->adt_list[y][x].exist && IsMapTileSelected(map_ids[z].id, x, y))
                 {
-                    continue;
+                    MapTile tile;
+                    tile.mapIndex = z;
+                    tile.x = x;
+                    tile.y = y;
+                    tiles.push_back(tile);
                 }
-                sprintf(mpq_filename, "World\\Maps\\%s\\%s_%u_%u.adt", map_ids[z].name, map_ids[z].name, x, y);
-                sprintf(output_filename, "%s/maps/%03u%02u%02u.map", output_path, map_ids[z].id, y, x);
-                ConvertADT(mpq_filename, output_filename, build);// , y, x);
             }
-            // draw progress bar
-            printf(" Processing........................%d%%\r", (100 * (y + 1)) / WDT_MAP_SIZE);
         }
     }
+
+    if (CONF_archive_order)
+    {
+        SortMapTilesByArchiveOffset(tiles);
+    }
+
+    if (CONF_plan)
+    {
+        PrintMapExtractionPlan(tiles, map_count);
+        delete [] areas;
+        delete [] map_ids;
+        return true;
+    }
+
+    MapConvertRun run;
+    run.map_count = map_count;
+    run.build = build;
+    run.settingsHash = GetConversionSettingsHash();
+    run.readFiles = 0;
+    run.readBytes = 0;
+    run.readSeconds = 0.0;
+
+    if (CONF_check_threads)
+    {
+        bool same = CheckMapConvertThreads(tiles, run, CONF_check_threads);
+        delete [] areas;
+        delete [] map_ids;
+        return same;
+    }
+
+    std::string manifest = output_path;
+    manifest += "/maps.manifest";
+
+    if (CONF_incremental && CONF_packed)
+    {
+        printf(" Incremental extraction is not supported for packed maps, converting all tiles\n");
+        CONF_incremental = false;
+    }
+
+    bool selected = !CONF_maps.empty() || !CONF_tiles.empty();
+    if (CONF_incremental || selected)
+    {
+        if (run.previous.load(manifest.c_str()))
+        {
+            // tiles outside the selection are neither converted nor removed,
+            // so they keep their entries
+            MapManifest::EntryMap const& entries = run.previous.getEntries();
+            for (MapManifest::EntryMap::const_iterator itr = entries.begin(); itr != entries.end(); ++itr)
+            {
+                if (!IsMapTileSelected(itr->second.mapId, itr->second.x, itr->second.y))
+                {
+                    run.current.set(itr->second);
+                }
+            }
+
+            if (CONF_incremental)
+            {
+                RemoveStaleMapTiles(tiles, run);
+            }
+        }
+        else if (CONF_incremental)
+        {
+            printf(" No manifest of an earlier run found, converting all tiles\n");
+        }
+    }
+
+    if (CONF_threads > 1)
+    {
+        printf(" Using %d threads for conversion\n", CONF_threads);
+        ConvertMapTilesPipelined(tiles, run);
+    }
+    else
+    {
+        ConvertMapTilesSerial(tiles, run);
+    }
+
+    // loading includes the decompression, compare runs on the same machine
+    printf("\n Read %u ADTs in %s order, %.1f MB in %.2fs (%.1f MB/s)\n", run.readFiles,
+           CONF_archive_order ? "archive" : "map", run.readBytes / 1048576.0, run.readSeconds,
+           run.readSeconds > 0.0 ? run.readBytes / 1048576.0 / run.readSeconds : 0.0);
+
+    run.current.save(manifest.c_str());
+
     delete [] areas;
     delete [] map_ids;
+    return true;
 }
 
 /**
@@ -1164,32 +2619,259 @@ bool ExtractFile(char const* mpq_name, std::string const& filename)
         fwrite(m.getPointer(), 1, m.getSize(), output);
     }
 
-    fclose(output);
-    return true;
-}
+    fclose(output);
+    return true;
+}
+
+/**
+ * @brief Writes extracted DBC files on worker threads
+ *
+ * The files are still read from the archives by the caller, libmpq is not
+ * thread safe. Writing overlaps with reading the next files and the next
+ * locale. Most DBC files are the same in every locale, a file with the same
+ * content as one written before becomes a hard link to it.
+ */
+class DBCFileWriter
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param threads
+         * @param writeIndex also write a .dbc.idx file for each file
+         */
+        DBCFileWriter(int threads, bool writeIndex) :
+            m_queue(threads * 4), m_writeIndex(writeIndex), m_written(0), m_linked(0), m_failed(0)
+        {
+            for (int i = 0; i < threads; ++i)
+            {
+                m_threads.push_back(std::thread(DBCFileWriter::run, this));
+            }
+        }
+
+        /**
+         * @brief
+         *
+         */
+        ~DBCFileWriter()
+        {
+            stop();
+        }
+
+        /**
+         * @brief Queues a file for writing, blocks while the writers are behind
+         *
+         * @param filename
+         * @param file read from the archives, deleted once written
+         */
+        void add(std::string const& filename, ConcurrentMPQFile* file)
+        {
+            Task task;
+            task.filename = filename;
+            task.file = file;
+            if (!m_queue.push(task))
+            {
+                delete file;
+            }
+        }
+
+        /**
+         * @brief Waits for all queued files and prints the totals
+         *
+         */
+        void finish()
+        {
+            stop();
+
+            printf(" Wrote %u DBC files, %u of them linked to an identical file", m_written + m_linked, m_linked);
+            if (m_failed)
+            {
+                printf(", %u failed", m_failed);
+            }
+            printf("\n\n");
+        }
+
+    private:
+        /**
+         * @brief
+         *
+         */
+        struct Task
+        {
+            std::string filename;   /**< TODO */
+            ConcurrentMPQFile* file; /**< TODO */
+        };
+
+        typedef std::pair<uint64, size_t> ContentKey;
+
+        void stop()
+        {
+            m_queue.close();
+            for (size_t i = 0; i < m_threads.size(); ++i)
+            {
+                m_threads[i].join();
+            }
+            m_threads.clear();
+        }
+
+        static void run(DBCFileWriter* writer)
+        {
+            Task task;
+            while (writer->m_queue.pop(task))
+            {
+                writer->write(task);
+                delete task.file;
+            }
+        }
+
+        void write(Task const& task)
+        {
+            char const* data = task.file->isEof() ? NULL : task.file->getBuffer();
+            size_t size = data ? task.file->getSize() : 0;
+            ContentKey key(hashBytes(data, size), size);
+
+            std::string original;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                std::map<ContentKey, std::string>::const_iterator itr = m_contents.find(key);
+                if (itr != m_contents.end())
+                {
+                    original = itr->second;
+                }
+            }
+
+            // the hash only finds the candidate, the bytes decide
+            if (!original.empty() && !sameContent(original, data, size))
+            {
+                original.clear();
+            }
+
+            // the file may be a link left by an earlier run, never write through it
+            remove(task.filename.c_str());
+            if (!original.empty() && LinkFile(original, task.filename))
+            {
+                if (m_writeIndex)
+                {
+                    std::string indexName = task.filename + ".idx";
+                    remove(indexName.c_str());
+                    if (!LinkFile(original + ".idx", indexName))
+                    {
+                        writeIndex(indexName, data, size);
+                    }
+                }
+
+                std::lock_guard<std::mutex> guard(m_lock);
+                ++m_linked;
+                return;
+            }
+
+            bool written = writeFile(task.filename, data, size);
+            if (written && m_writeIndex)
+            {
+                std::string indexName = task.filename + ".idx";
+                remove(indexName.c_str());
+                writeIndex(indexName, data, size);
+            }
+
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (!written)
+            {
+                printf("Can not write the output file '%s'\n", task.filename.c_str());
+                ++m_failed;
+                return;
+            }
+
+            m_contents.insert(std::make_pair(key, task.filename));
+            ++m_written;
+        }
+
+        /**
+         * @brief Compares a file written before with the data of a new one
+         *
+         * @param filename
+         * @param data
+         * @param size
+         * @return bool false if they differ or the file can not be read
+         */
+        static bool sameContent(std::string const& filename, char const* data, size_t size)
+        {
+            FILE* input = fopen(filename.c_str(), "rb");
+            if (!input)
+            {
+                return false;
+            }
+
+            char buffer[65536];
+            size_t offset = 0;
+            bool same = true;
+            while (same)
+            {
+                size_t count = fread(buffer, 1, sizeof(buffer), input);
+                if (!count)
+                {
+                    break;
+                }
+                same = offset + count <= size && memcmp(buffer, data + offset, count) == 0;
+                offset += count;
+            }
+            fclose(input);
+            return same && offset == size;
+        }
+
+        static bool writeFile(std::string const& filename, void const* data, size_t size)
+        {
+            FILE* output = fopen(filename.c_str(), "wb");
+            bool written = output && (!size || fwrite(data, size, 1, output) == 1);
+            if (output && fclose(output) != 0)
+            {
+                written = false;
+            }
+            return written;
+        }
+
+        static void writeIndex(std::string const& filename, char const* data, size_t size)
+        {
+            std::vector<char> index;
+            if (!BuildDBCIndex(data, size, index))
+            {
+                printf("No index written for '%s', it is not a valid dbc file\n", filename.c_str());
+                return;
+            }
+
+            if (!writeFile(filename, &index[0], index.size()))
+            {
+                printf("Can not write the output file '%s'\n", filename.c_str());
+            }
+        }
+
+        DBCFileWriter(DBCFileWriter const&);
+        DBCFileWriter& operator=(DBCFileWriter const&);
+
+        BoundedQueue<Task> m_queue;                         /**< TODO */
+        std::vector<std::thread> m_threads;                 /**< TODO */
+        bool m_writeIndex;                                  /**< TODO */
+        std::mutex m_lock;                                  /**< TODO */
+        std::map<ContentKey, std::string> m_contents;       /**< first file written with each hash and size */
+        uint32 m_written;                                   /**< TODO */
+        uint32 m_linked;                                    /**< TODO */
+        uint32 m_failed;                                    /**< TODO */
+};
 
 /**
  * @brief
  *
+ * @param locale
+ * @param basicLocale
+ * @param writer
  */
-void ExtractDBCFiles(int locale, bool basicLocale)
+void ExtractDBCFiles(int locale, bool basicLocale, DBCFileWriter& writer)
 {
     printf(" ___________________________________    \n");
     printf("\n Extracting client database files...\n");
 
-    std::set<std::string> dbcfiles;
-
     // get DBC file list
-    for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
-    {
-        vector<string> files;
-        (*i)->GetFileListTo(files);
-        for (vector<string>::iterator iter = files.begin(); iter != files.end(); ++iter)
-            if (iter->rfind(".dbc") == iter->length() - strlen(".dbc"))
-            {
-                dbcfiles.insert(*iter);
-            }
-    }
+    MPQFileIndex::EntryList dbcfiles;
+    gFileIndex.findByExtension(".dbc", dbcfiles);
 
     std::string path = output_path;
     path += "/dbc/";
@@ -1220,19 +2902,29 @@ void ExtractDBCFiles(int locale, bool basicLocale)
         }
     }
 
-    // extract DBCs
-    int count = 0;
-    for (set<string>::iterator iter = dbcfiles.begin(); iter != dbcfiles.end(); ++iter)
+    // extract DBCs, the files are written by the writer threads
+    for (MPQFileIndex::EntryList::const_iterator iter = dbcfiles.begin(); iter != dbcfiles.end(); ++iter)
     {
         string filename = path;
-        filename += (iter->c_str() + strlen("DBFilesClient\\"));
+        filename += ((*iter)->name.c_str() + strlen("DBFilesClient\\"));
 
-        if (ExtractFile(iter->c_str(), filename))
-        {
-            ++count;
-        }
+        writer.add(filename, new ConcurrentMPQFile((*iter)->name.c_str()));
+    }
+    printf(" Read %u files\n\n", uint32(dbcfiles.size()));
+}
+
+/**
+ * @brief Opens an archive for MPQFile and ConcurrentMPQFile
+ *
+ * @param filename
+ */
+static void OpenMPQArchive(char const* filename)
+{
+    MPQArchive* archive = new MPQArchive(filename);
+    if (!gOpenArchives.empty() && gOpenArchives.front() == archive)
+    {
+        ConcurrentMPQ::addArchive(filename);
     }
-    printf(" Extracted %u files\n\n", count);
 }
 
 void LoadLocaleMPQFiles(int const locale)
@@ -1240,7 +2932,7 @@ void LoadLocaleMPQFiles(int const locale)
     char filename[512];
 
     sprintf(filename, "%s/Data/%s/locale-%s.MPQ", input_path, langs[locale], langs[locale]);
-    new MPQArchive(filename);
+    OpenMPQArchive(filename);
 
     for (int i = 1; i < 5; ++i)
     {
@@ -1253,7 +2945,7 @@ void LoadLocaleMPQFiles(int const locale)
         sprintf(filename, "%s/Data/%s/patch-%s%s.MPQ", input_path, langs[locale], langs[locale], ext);
         if (ClientFileExists(filename))
         {
-            new MPQArchive(filename);
+            OpenMPQArchive(filename);
         }
     }
 }
@@ -1271,7 +2963,7 @@ void LoadCommonMPQFiles()
         sprintf_s(filename, "%s/Data/%s", input_path, CONF_mpq_list[i]);
         if (ClientFileExists(filename))
         {
-            new MPQArchive(filename);
+            OpenMPQArchive(filename);
         }
     }
 }
@@ -1287,6 +2979,453 @@ inline void CloseMPQFiles()
         (*j)->close();
     }
     gOpenArchives.clear();
+    ConcurrentMPQ::clearArchives();
+    gFileIndex.clear();
+}
+
+//============================================
+// Concurrent archive reads
+//============================================
+
+/**
+ * @brief Files read by the archive stress test and what a single threaded
+ *        read gave for them
+ *
+ */
+struct MpqStressRun
+{
+    std::vector<std::string> files;         /**< TODO */
+    std::vector<uint64> hashes;             /**< TODO */
+    std::vector<size_t> sizes;              /**< TODO */
+    std::atomic<uint32> mismatches;         /**< TODO */
+    std::atomic<uint64> bytes;              /**< TODO */
+};
+
+/**
+ * @brief Reads all files once, starting at a different file in each thread
+ *
+ * @param run
+ * @param first
+ */
+static void MpqStressRead(MpqStressRun* run, size_t first)
+{
+    size_t count = run->files.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t index = (first + i) % count;
+        ConcurrentMPQFile file(run->files[index].c_str());
+        size_t size = file.isEof() ? 0 : file.getSize();
+        if (size != run->sizes[index] || hashBytes(file.getBuffer(), size) != run->hashes[index])
+        {
+            printf(" Mismatch reading %s\n", run->files[index].c_str());
+            ++run->mismatches;
+        }
+        run->bytes += size;
+    }
+}
+
+/**
+ * @brief Reads every file of the open archives on several threads at once
+ *        and compares the contents with MPQFile
+ *
+ * @param threads
+ * @return bool false if any file differed
+ */
+bool StressConcurrentMPQ(int threads)
+{
+    MpqStressRun run;
+    std::vector<MPQFileIndexEntry> const& files = gFileIndex.getFiles();
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        run.files.push_back(files[i].name);
+    }
+    run.mismatches = 0;
+    run.bytes = 0;
+
+    printf(" Reading %u files from %u archives with MPQFile...\n", uint32(run.files.size()), uint32(ConcurrentMPQ::getArchiveCount()));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64 serialBytes = 0;
+    for (size_t i = 0; i < run.files.size(); ++i)
+    {
+        MPQFile file(run.files[i].c_str());
+        size_t size = file.isEof() ? 0 : file.getSize();
+        run.sizes.push_back(size);
+        run.hashes.push_back(hashBytes(file.getBuffer(), size));
+        serialBytes += size;
+    }
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf(" Reading them on %d threads with ConcurrentMPQFile...\n", threads);
+    start = std::chrono::steady_clock::now();
+    std::vector<std::thread> readers;
+    for (int i = 0; i < threads; ++i)
+    {
+        readers.push_back(std::thread(MpqStressRead, &run, run.files.size() * i / threads));
+    }
+    for (size_t i = 0; i < readers.size(); ++i)
+    {
+        readers[i].join();
+    }
+    double parallelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf(" Single thread: %.1f MB in %.2fs (%.1f MB/s)\n", serialBytes / 1048576.0, serialSeconds,
+           serialSeconds > 0.0 ? serialBytes / 1048576.0 / serialSeconds : 0.0);
+    printf(" %d threads:     %.1f MB in %.2fs (%.1f MB/s)\n", threads, run.bytes / 1048576.0, parallelSeconds,
+           parallelSeconds > 0.0 ? run.bytes / 1048576.0 / parallelSeconds : 0.0);
+    printf(" %u mismatches\n", uint32(run.mismatches));
+    return run.mismatches == 0;
+}
+
+//============================================
+// Half float round trip report
+//============================================
+
+/**
+ * @brief Round trip error of storing a set of heights as half floats
+ *
+ */
+struct Float16Error
+{
+    Float16Error() : tiles(0), values(0), exactValues(0), sumSquares(0.0), maxError(0.0f) {}
+
+    uint32 tiles;               /**< TODO */
+    uint64 values;              /**< TODO */
+    uint64 exactValues;         /**< stored without error, only counted in the sizes */
+    double sumSquares;          /**< TODO */
+    float maxError;             /**< TODO */
+    std::string worstTile;      /**< TODO */
+
+    /**
+     * @brief Converts heights the way ConvertADT does and folds the errors in
+     *
+     * @param heights
+     * @param count
+     * @param base
+     * @param tile name for the worst tile line
+     */
+    void add(float const* heights, size_t count, float base, std::string const& tile)
+    {
+        std::vector<uint16> half(count);
+        HeightToHalf(heights, count, base, &half[0]);
+
+        float tileMax = 0.0f;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float error = fabsf(HalfToFloat(half[i]) + base - heights[i]);
+            sumSquares += double(error) * error;
+            if (tileMax < error)
+            {
+                tileMax = error;
+            }
+        }
+
+        ++tiles;
+        values += count;
+        if (maxError < tileMax || worstTile.empty())
+        {
+            maxError = tileMax;
+            worstTile = tile;
+        }
+    }
+
+    /**
+     * @brief
+     *
+     * @param what
+     */
+    void print(char const* what) const
+    {
+        if (!tiles)
+        {
+            printf("   %-8s no float heights found\n", what);
+            return;
+        }
+        printf("   %-8s %u tiles, rms error %.5f, max error %.5f (%s)\n", what, tiles,
+               sqrt(sumSquares / double(values)), maxError, worstTile.c_str());
+        uint64 stored = values + exactValues;
+        printf("            %llu bytes as float, %llu bytes as half float\n",
+               (unsigned long long)(stored * sizeof(float)), (unsigned long long)(stored * sizeof(uint16)));
+    }
+};
+
+/**
+ * @brief Totals of a half float report
+ *
+ */
+struct Float16Report
+{
+    Float16Report() : tiles(0), invalid(0), intPacked(0), alreadyHalf(0), liquidMeshChanged(0) {}
+
+    uint32 tiles;               /**< TODO */
+    uint32 invalid;             /**< TODO */
+    uint32 intPacked;           /**< heights packed as int, --fp16 keeps those */
+    uint32 alreadyHalf;         /**< TODO */
+    uint32 liquidMeshChanged;   /**< tiles whose liquid mesh would differ as half floats */
+    Float16Error terrain;       /**< TODO */
+    Float16Error liquid;        /**< TODO */
+};
+
+/**
+ * @brief Checks that the liquid heights of a float tile give the mmap
+ *        generator the same liquid mesh when stored as half floats
+ *
+ * The generator tells points without liquid apart by their exact height when
+ * it closes the liquid edges, so those have to read back exactly and no point
+ * with liquid may read back as one of them. The other heights only move by
+ * the rounding the report prints.
+ *
+ * @param heights
+ * @param count
+ * @param liquidLevel
+ * @return bool
+ */
+bool SameLiquidMeshAsHalf(float const* heights, size_t count, float liquidLevel)
+{
+    std::vector<uint16> half(count);
+    LiquidHeightToHalf(heights, count, liquidLevel, &half[0]);
+    for (size_t i = 0; i < count; ++i)
+    {
+        // read back the way TerrainBuilder::loadMap does
+        float height = half[i] == MAP_LIQUID_HALF_NO_HEIGHT ? CONF_use_minHeight : HalfToFloat(half[i]) + liquidLevel;
+        if ((heights[i] == CONF_use_minHeight) != (height == CONF_use_minHeight))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Adds the float heights of a .map file to the report
+ *
+ * @param data contents of the .map file
+ * @param size
+ * @param name
+ * @param report
+ */
+void ReportTileFloat16Error(char const* data, size_t size, std::string const& name, Float16Report& report)
+{
+    map_fileheader const* header = (map_fileheader const*)data;
+    if (size < sizeof(map_fileheader) || header->mapMagic != *(uint32 const*)MAP_MAGIC ||
+        size_t(header->heightMapOffset) + sizeof(map_heightHeader) > size)
+    {
+        printf(" %s is not a valid .map file\n", name.c_str());
+        ++report.invalid;
+        return;
+    }
+    ++report.tiles;
+
+    map_heightHeader const* heightHeader = (map_heightHeader const*)(data + header->heightMapOffset);
+    if (heightHeader->flags & MAP_HEIGHT_AS_FLOAT16)
+    {
+        ++report.alreadyHalf;
+    }
+    else if (heightHeader->flags & (MAP_HEIGHT_AS_INT8 | MAP_HEIGHT_AS_INT16))
+    {
+        ++report.intPacked;
+    }
+    else if (!(heightHeader->flags & MAP_HEIGHT_NO_HEIGHT))
+    {
+        size_t count = (ADT_GRID_SIZE + 1) * (ADT_GRID_SIZE + 1) + ADT_GRID_SIZE * ADT_GRID_SIZE;
+        size_t offset = header->heightMapOffset + sizeof(map_heightHeader);
+        if (offset + count * sizeof(float) <= size)
+        {
+            // V9 and V8 are stored one after the other
+            std::vector<float> heights(count);
+            memcpy(&heights[0], data + offset, count * sizeof(float));
+            report.terrain.add(&heights[0], count, (heightHeader->gridHeight + heightHeader->gridMaxHeight) * 0.5f, name);
+        }
+    }
+
+    if (!header->liquidMapOffset || size_t(header->liquidMapOffset) + sizeof(map_liquidHeader) > size)
+    {
+        return;
+    }
+
+    map_liquidHeader const* liquidHeader = (map_liquidHeader const*)(data + header->liquidMapOffset);
+    if (liquidHeader->flags & (MAP_LIQUID_NO_HEIGHT | MAP_LIQUID_HEIGHT_AS_FLOAT16))
+    {
+        return;
+    }
+
+    size_t offset = header->liquidMapOffset + sizeof(map_liquidHeader);
+    if (!(liquidHeader->flags & MAP_LIQUID_NO_TYPE))
+    {
+        offset += sizeof(uint16) * ADT_CELLS_PER_GRID * ADT_CELLS_PER_GRID + sizeof(uint8) * ADT_CELLS_PER_GRID * ADT_CELLS_PER_GRID;
+    }
+
+    std::vector<float> heights;
+    if (liquidHeader->flags & MAP_LIQUID_SPARSE)
+    {
+        uint16 cells[ADT_CELLS_PER_GRID];
+        if (offset + sizeof(cells) > size)
+        {
+            return;
+        }
+        memcpy(cells, data + offset, sizeof(cells));
+        offset += sizeof(cells);
+
+        // the show bits of each cell come before its heights
+        size_t cellHeights = (ADT_CELL_SIZE + 1) * (ADT_CELL_SIZE + 1);
+        for (int cy = 0; cy < ADT_CELLS_PER_GRID; ++cy)
+        {
+            for (int cx = 0; cx < ADT_CELLS_PER_GRID; ++cx)
+            {
+                if (!(cells[cy] & (1 << cx)))
+                {
+                    continue;
+                }
+                offset += sizeof(uint64);
+                if (offset + cellHeights * sizeof(float) > size)
+                {
+                    return;
+                }
+                heights.insert(heights.end(), (float const*)(data + offset), (float const*)(data + offset) + cellHeights);
+                offset += cellHeights * sizeof(float);
+            }
+        }
+    }
+    else
+    {
+        size_t count = size_t(liquidHeader->width) * liquidHeader->height;
+        if (offset + count * sizeof(float) > size)
+        {
+            return;
+        }
+        heights.resize(count);
+        if (count)
+        {
+            memcpy(&heights[0], data + offset, count * sizeof(float));
+        }
+    }
+
+    if (!heights.empty() && !SameLiquidMeshAsHalf(&heights[0], heights.size(), liquidHeader->liquidLevel))
+    {
+        printf(" %s would get a different liquid mesh with half floats\n", name.c_str());
+        ++report.liquidMeshChanged;
+    }
+
+    // points without liquid are stored exactly, they would only skew the error
+    std::vector<float> liquidHeights;
+    for (size_t i = 0; i < heights.size(); ++i)
+    {
+        if (heights[i] != CONF_use_minHeight)
+        {
+            liquidHeights.push_back(heights[i]);
+        }
+    }
+
+    report.liquid.exactValues += heights.size() - liquidHeights.size();
+    if (!liquidHeights.empty())
+    {
+        report.liquid.add(&liquidHeights[0], liquidHeights.size(), liquidHeader->liquidLevel, name);
+    }
+}
+
+/**
+ * @brief Reads a whole file
+ *
+ * @param filename
+ * @param data
+ * @return bool
+ */
+bool ReadWholeFile(std::string const& filename, std::vector<char>& data)
+{
+    FILE* input = fopen(filename.c_str(), "rb");
+    if (!input)
+    {
+        return false;
+    }
+
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    bool ok = data.empty() || fread(&data[0], data.size(), 1, input) == 1;
+    fclose(input);
+    return ok;
+}
+
+/**
+ * @brief Prints the error --fp16 would give the extracted maps in a folder,
+ *        from loose .map files as well as packed .pmap files
+ *
+ * Only heights still stored as floats are looked at, the same ones --fp16
+ * converts. Compare its numbers with the server's height tolerances before
+ * enabling the mode. Liquid tiles are also checked to build the same mmap
+ * liquid mesh as half floats.
+ *
+ * @param path
+ * @return bool false if the folder can not be read or a liquid mesh differs
+ */
+bool ReportFloat16Error(char const* path)
+{
+    std::vector<std::string> mapFiles, packedFiles;
+    if (!ListDir(path, ".map", mapFiles) || !ListDir(path, ".pmap", packedFiles))
+    {
+        printf("Can not read the folder '%s'\n", path);
+        return false;
+    }
+
+    printf(" Half float round trip report for %s\n", path);
+    printf(" Using the %s conversion kernel\n", GetHeightPackingKernelName(GetHeightPackingKernel()));
+
+    Float16Report report;
+    std::vector<char> data;
+    for (size_t i = 0; i < mapFiles.size(); ++i)
+    {
+        std::string filename = std::string(path) + "/" + mapFiles[i];
+        if (!ReadWholeFile(filename, data))
+        {
+            printf(" Can not read %s\n", filename.c_str());
+            ++report.invalid;
+            continue;
+        }
+        ReportTileFloat16Error(data.empty() ? NULL : &data[0], data.size(), mapFiles[i], report);
+    }
+
+    for (size_t i = 0; i < packedFiles.size(); ++i)
+    {
+        std::string filename = std::string(path) + "/" + packedFiles[i];
+        size_t indexEnd = sizeof(map_packedHeader) + sizeof(map_packedTile) * MAP_PACKED_GRID_SIZE * MAP_PACKED_GRID_SIZE;
+        if (!ReadWholeFile(filename, data) || data.size() < indexEnd ||
+            ((map_packedHeader const*)&data[0])->packMagic != *(uint32 const*)MAP_PACKED_MAGIC)
+        {
+            printf(" %s is not a valid packed map file\n", filename.c_str());
+            ++report.invalid;
+            continue;
+        }
+
+        map_packedTile const* index = (map_packedTile const*)(&data[0] + sizeof(map_packedHeader));
+        for (uint32 y = 0; y < MAP_PACKED_GRID_SIZE; ++y)
+        {
+            for (uint32 x = 0; x < MAP_PACKED_GRID_SIZE; ++x)
+            {
+                map_packedTile const& tile = index[y * MAP_PACKED_GRID_SIZE + x];
+                if (!tile.size)
+                {
+                    continue;
+                }
+
+                char name[512];
+                sprintf(name, "%s tile %02u,%02u", packedFiles[i].c_str(), y, x);
+                if (tile.offset < indexEnd || size_t(tile.offset) + tile.size > data.size())
+                {
+                    printf(" %s is truncated\n", name);
+                    ++report.invalid;
+                    continue;
+                }
+                ReportTileFloat16Error(&data[0] + tile.offset, tile.size, name, report);
+            }
+        }
+    }
+
+    printf("   %u tiles read, %u invalid, heights of %u packed as int, %u already half floats\n",
+           report.tiles, report.invalid, report.intPacked, report.alreadyHalf);
+    report.terrain.print("terrain");
+    report.liquid.print("liquid");
+    printf("   %u tiles would get a different liquid mesh\n", report.liquidMeshChanged);
+    return report.liquidMeshChanged == 0;
 }
 
 /**
@@ -1298,6 +3437,22 @@ inline void CloseMPQFiles()
  */
 int main(int argc, char** argv)
 {
+    // The benchmark and the report do not need a client
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--benchmark-heights") == 0)
+        {
+            int iterations = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            BenchmarkHeightPacking(iterations > 0 ? iterations : 1000);
+            return 0;
+        }
+        if (strcmp(argv[i], "--fp16-report") == 0)
+        {
+            char const* path = i + 1 < argc ? argv[i + 1] : "./maps";
+            return ReportFloat16Error(path) ? 0 : 1;
+        }
+    }
+
     int thisBuild = getBuildNumber();
     iCoreNumber = getCoreNumberFromBuild(thisBuild);
     showBanner("DBC Extractor & Map Generator", iCoreNumber);
@@ -1329,7 +3484,37 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (CONF_cache_dir && !MPQFileCache::open(CONF_cache_dir, CONF_cache_size * 1024 * 1024))
+    {
+        return 1;
+    }
+
+    if (CONF_mpq_stress)
+    {
+        if (iCoreNumber == CLIENT_TBC || iCoreNumber == CLIENT_WOTLK || iCoreNumber == CLIENT_CATA)
+        {
+            for (int i = 0; i < LANG_COUNT; i++)
+            {
+                char tmp1[512];
+                sprintf(tmp1, "%s/Data/%s/locale-%s.MPQ", input_path, langs[i], langs[i]);
+                if (ClientFileExists(tmp1))
+                {
+                    LoadLocaleMPQFiles(i);
+                    break;
+                }
+            }
+        }
+        LoadCommonMPQFiles();
+        gFileIndex.build();
+        bool success = StressConcurrentMPQ(CONF_mpq_stress);
+        CloseMPQFiles();
+        MPQFileCache::printSummary();
+        return success ? 0 : 1;
+    }
+
     int FirstLocale = -1;
+    int result = 0;
+    DBCFileWriter dbcWriter(CONF_threads, CONF_dbc_index);
 
     if (iCoreNumber == CLIENT_TBC || iCoreNumber == CLIENT_WOTLK || iCoreNumber == CLIENT_CATA)
     {
@@ -1343,6 +3528,7 @@ int main(int argc, char** argv)
 
                 //Open MPQs
                 LoadLocaleMPQFiles(i);
+                gFileIndex.build();
                 if ((CONF_extract & EXTRACT_DBC) == 0)
                 {
                     FirstLocale = i;
@@ -1355,11 +3541,11 @@ int main(int argc, char** argv)
                 {
                     FirstLocale = i;
                     printf(" Detected client build: %i \n", thisBuild);
-                    ExtractDBCFiles(i, true);
+                    ExtractDBCFiles(i, true, dbcWriter);
                 }
                 else
                 {
-                    ExtractDBCFiles(i, false);
+                    ExtractDBCFiles(i, false, dbcWriter);
                 }
 
                 //Close MPQs
@@ -1367,6 +3553,11 @@ int main(int argc, char** argv)
             }
         }
 
+        if (CONF_extract & EXTRACT_DBC)
+        {
+            dbcWriter.finish();
+        }
+
         if (FirstLocale < 0)
         {
             printf("No locales detected\n");
@@ -1380,9 +3571,13 @@ int main(int argc, char** argv)
             // Open MPQs
             LoadLocaleMPQFiles(FirstLocale);
             LoadCommonMPQFiles();
+            gFileIndex.build();
 
             // Extract maps
-            ExtractMapsFromMpq(thisBuild);
+            if (!ExtractMapsFromMpq(thisBuild))
+            {
+                result = 1;
+            }
 
             // Close MPQs
             CloseMPQFiles();
@@ -1392,21 +3587,28 @@ int main(int argc, char** argv)
     {
         // Open MPQs
         LoadCommonMPQFiles();
+        gFileIndex.build();
 
         // Extract dbc
         if (CONF_extract & EXTRACT_DBC)
         {
-            ExtractDBCFiles(0, true);
+            ExtractDBCFiles(0, true, dbcWriter);
+            dbcWriter.finish();
         }
 
         // Extract maps
         if (CONF_extract & EXTRACT_MAP)
         {
-            ExtractMapsFromMpq(thisBuild);
+            if (!ExtractMapsFromMpq(thisBuild))
+            {
+                result = 1;
+            }
         }
 
         // Close MPQs
         CloseMPQFiles();
     }
-    return 0;
+
+    MPQFileCache::printSummary();
+    return result;
 }
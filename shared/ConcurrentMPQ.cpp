@@ -0,0 +1,221 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "ConcurrentMPQ.h"
+#include "ExtractorCommon.h"
+#include "MPQFileCache.h"
+#include "MPQFileIndex.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <atomic>
+
+static std::vector<std::string> archiveNames;      /**< highest priority first */
+static std::vector<uint64_t> archiveKeys;          /**< in the order of archiveNames */
+static std::atomic<unsigned int> archiveGeneration(1); /**< changed with archiveNames */
+
+/**
+ * @brief Archive handles of a thread, closed when the thread exits
+ *
+ */
+struct ThreadArchives
+{
+    ThreadArchives() : generation(0) {}
+    ~ThreadArchives() { close(); }
+
+    void close()
+    {
+        for (size_t i = 0; i < handles.size(); ++i)
+        {
+            if (handles[i])
+            {
+                libmpq__archive_close(handles[i]);
+            }
+        }
+        handles.clear();
+    }
+
+    unsigned int generation;                /**< of the list the handles were opened from */
+    std::vector<mpq_archive_s*> handles;    /**< TODO */
+};
+
+static thread_local ThreadArchives threadArchives;
+
+void ConcurrentMPQ::addArchive(std::string const& filename)
+{
+    // the path differs between the extractors, the file name does not
+    size_t nameStart = filename.find_last_of("/\\");
+    std::string name = MPQFileIndex::normalize(filename.substr(nameStart == std::string::npos ? 0 : nameStart + 1));
+    uint64_t key = hashBytes(name.c_str(), name.size());
+
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) == 0)
+    {
+        uint64_t size = uint64_t(fileStat.st_size);
+        uint64_t time = uint64_t(fileStat.st_mtime);
+        key = hashBytes(&size, sizeof(size), key);
+        key = hashBytes(&time, sizeof(time), key);
+    }
+
+    archiveNames.insert(archiveNames.begin(), filename);
+    archiveKeys.insert(archiveKeys.begin(), key);
+    ++archiveGeneration;
+}
+
+void ConcurrentMPQ::clearArchives()
+{
+    archiveNames.clear();
+    archiveKeys.clear();
+    ++archiveGeneration;
+    threadArchives.close();
+}
+
+size_t ConcurrentMPQ::getArchiveCount()
+{
+    return archiveNames.size();
+}
+
+std::vector<mpq_archive_s*> const& ConcurrentMPQ::getThreadArchives()
+{
+    unsigned int generation = archiveGeneration;
+    if (threadArchives.generation != generation)
+    {
+        threadArchives.close();
+        threadArchives.generation = generation;
+        threadArchives.handles.resize(archiveNames.size(), NULL);
+        for (size_t i = 0; i < archiveNames.size(); ++i)
+        {
+            if (libmpq__archive_open(&threadArchives.handles[i], archiveNames[i].c_str(), -1) != 0)
+            {
+                threadArchives.handles[i] = NULL;
+            }
+        }
+    }
+    return threadArchives.handles;
+}
+
+uint64_t ConcurrentMPQ::getArchiveKey(size_t archive)
+{
+    return archiveKeys[archive];
+}
+
+ConcurrentMPQFile::ConcurrentMPQFile(char const* filename) :
+    eof(false), buffer(0), pointer(0), size(0), mapped(NULL)
+{
+    std::vector<mpq_archive_s*> const& archives = ConcurrentMPQ::getThreadArchives();
+    for (size_t i = 0; i < archives.size(); ++i)
+    {
+        uint32_t filenum;
+        if (!archives[i] || libmpq__file_number(archives[i], filename, &filenum) != 0)
+        {
+            continue;
+        }
+
+        libmpq__off_t transferred;
+        libmpq__file_unpacked_size(archives[i], filenum, &size);
+
+        // files of size 0 or 1 are treated as missing, as by MPQFile
+        if (size <= 1)
+        {
+            eof = true;
+            buffer = 0;
+            return;
+        }
+
+        uint64_t cacheKey = 0;
+        if (MPQFileCache::isOpen())
+        {
+            std::string name = MPQFileIndex::normalize(filename);
+            cacheKey = hashBytes(name.c_str(), name.size(), ConcurrentMPQ::getArchiveKey(i));
+            mapped = MPQFileCache::find(cacheKey);
+            if (mapped && mapped->getSize() == size_t(size))
+            {
+                buffer = (char*)mapped->getData();
+                return;
+            }
+            delete mapped;
+            mapped = NULL;
+        }
+
+        buffer = new char[size];
+        libmpq__file_read(archives[i], filenum, (uint8_t*)buffer, size, &transferred);
+        if (cacheKey && transferred == size)
+        {
+            MPQFileCache::store(cacheKey, buffer, size);
+        }
+        return;
+    }
+
+    eof = true;
+    buffer = 0;
+}
+
+size_t ConcurrentMPQFile::read(void* dest, size_t bytes)
+{
+    if (eof)
+    {
+        return 0;
+    }
+
+    size_t rpos = pointer + bytes;
+    if (rpos > size_t(size))
+    {
+        bytes = size - pointer;
+        eof = true;
+    }
+
+    memcpy(dest, &(buffer[pointer]), bytes);
+
+    pointer = rpos;
+
+    return bytes;
+}
+
+void ConcurrentMPQFile::seek(int offset)
+{
+    pointer = offset;
+    eof = (pointer >= size);
+}
+
+void ConcurrentMPQFile::seekRelative(int offset)
+{
+    pointer += offset;
+    eof = (pointer >= size);
+}
+
+void ConcurrentMPQFile::close()
+{
+    if (mapped)
+    {
+        delete mapped;
+        mapped = NULL;
+    }
+    else
+    {
+        delete[] buffer;
+    }
+    buffer = 0;
+    eof = true;
+}
@@ -0,0 +1,177 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef CONCURRENT_MPQ_H
+#define CONCURRENT_MPQ_H
+
+#include <string>
+#include <vector>
+#include <libmpq/mpq.h>
+
+class MappedFile;
+
+/**
+ * @brief Archives that any number of threads can read from at the same time
+ *
+ * libmpq keeps the state of a read in the archive handle, so the archives of
+ * gOpenArchives can only be used by one thread. Here every thread opens its
+ * own handles of the registered archives when it first reads a file.
+ * Archives are registered next to the MPQArchive of the same file, in the
+ * same order, so both find a file in the same archive.
+ *
+ * The list may only be changed while no other thread reads from it.
+ */
+class ConcurrentMPQ
+{
+    public:
+        /**
+         * @brief Adds an archive with a higher priority than those added before
+         *
+         * @param filename
+         */
+        static void addArchive(std::string const& filename);
+        /**
+         * @brief Forgets all archives, handles of other threads are closed
+         *        the next time they read
+         *
+         */
+        static void clearArchives();
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        static size_t getArchiveCount();
+
+    private:
+        friend class ConcurrentMPQFile;
+
+        /**
+         * @brief The calling thread's handles of the registered archives,
+         *        highest priority first. A handle is NULL if the archive
+         *        could not be opened.
+         *
+         * @return const std::vector<mpq_archive_s *>
+         */
+        static std::vector<mpq_archive_s*> const& getThreadArchives();
+        /**
+         * @brief Hash of the name, size and modification time of an archive,
+         *        in the order of getThreadArchives
+         *
+         * @param archive
+         * @return uint64_t
+         */
+        static uint64_t getArchiveKey(size_t archive);
+};
+
+/**
+ * @brief A file read from the ConcurrentMPQ archives
+ *
+ * Same interface as MPQFile, the whole file is decompressed when it is
+ * opened. With an open MPQFileCache the file is mapped from the cache
+ * instead when it was decompressed before.
+ */
+class ConcurrentMPQFile
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param filename
+         */
+        ConcurrentMPQFile(char const* filename);
+        /**
+         * @brief
+         *
+         */
+        ~ConcurrentMPQFile() { close(); }
+
+        /**
+         * @brief
+         *
+         * @param dest
+         * @param bytes
+         * @return size_t
+         */
+        size_t read(void* dest, size_t bytes);
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        size_t getSize() { return size; }
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        size_t getPos() { return pointer; }
+        /**
+         * @brief
+         *
+         * @return char
+         */
+        char* getBuffer() { return buffer; }
+        /**
+         * @brief
+         *
+         * @return char
+         */
+        char* getPointer() { return buffer + pointer; }
+        /**
+         * @brief
+         *
+         * @return bool
+         */
+        bool isEof() { return eof; }
+        /**
+         * @brief
+         *
+         * @param offset
+         */
+        void seek(int offset);
+        /**
+         * @brief
+         *
+         * @param offset
+         */
+        void seekRelative(int offset);
+        /**
+         * @brief
+         *
+         */
+        void close();
+
+    private:
+        ConcurrentMPQFile(ConcurrentMPQFile const&);
+        void operator=(ConcurrentMPQFile const&);
+
+        bool eof;               /**< TODO */
+        char* buffer;           /**< TODO */
+        libmpq__off_t pointer;  /**< TODO */
+        libmpq__off_t size;     /**< TODO */
+        MappedFile* mapped;     /**< cache file the buffer points into, NULL if it was decompressed */
+};
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef DBCTABLE_H
+#define DBCTABLE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "dbcfile.h"
+
+/*
+ * Layouts of the DBC files read by the extractors. Each layout names the
+ * columns that are used and the number of fields a file needs to have them.
+ * The columns are the same in all clients the extractors support, a client
+ * with a different layout needs its own struct.
+ */
+
+/**
+ * @brief Map.dbc
+ *
+ */
+struct MapDBC
+{
+    static constexpr char const* Name = "Map.dbc";
+    static constexpr size_t FieldCount = 2;
+
+    static constexpr size_t ID = 0;
+    static constexpr size_t InternalName = 1;               /**< string */
+
+    static constexpr bool isString(size_t field) { return field == InternalName; }
+};
+
+/**
+ * @brief AreaTable.dbc
+ *
+ */
+struct AreaTableDBC
+{
+    static constexpr char const* Name = "AreaTable.dbc";
+    static constexpr size_t FieldCount = 4;
+
+    static constexpr size_t ID = 0;
+    static constexpr size_t ExploreFlag = 3;                /**< bit of the area in the explored zones */
+
+    static constexpr bool isString(size_t /*field*/) { return false; }
+};
+
+/**
+ * @brief LiquidType.dbc
+ *
+ */
+struct LiquidTypeDBC
+{
+    static constexpr char const* Name = "LiquidType.dbc";
+    static constexpr size_t FieldCount = 4;
+
+    static constexpr size_t ID = 0;
+    static constexpr size_t Type = 3;                       /**< water, ocean, magma or slime */
+
+    static constexpr bool isString(size_t /*field*/) { return false; }
+};
+
+/**
+ * @brief GameObjectDisplayInfo.dbc
+ *
+ */
+struct GameObjectDisplayInfoDBC
+{
+    static constexpr char const* Name = "GameObjectDisplayInfo.dbc";
+    static constexpr size_t FieldCount = 2;
+
+    static constexpr size_t ID = 0;
+    static constexpr size_t ModelName = 1;                  /**< string */
+
+    static constexpr bool isString(size_t field) { return field == ModelName; }
+};
+
+/**
+ * @brief Typed view of an opened DBC file
+ *
+ * The file is checked against the layout once in open(), so reading a
+ * field is a plain load without the checks of DBCFile::Record.
+ */
+template<class Layout>
+class DBCTable
+{
+    public:
+        /**
+         * @brief
+         *
+         */
+        class Row
+        {
+            public:
+                Row() : m_fields(NULL), m_strings(NULL) {}
+
+                /**
+                 * @brief
+                 *
+                 * @return unsigned int
+                 */
+                template<size_t Field>
+                unsigned int getUInt() const
+                {
+                    static_assert(Field < Layout::FieldCount, "field is not part of the layout");
+                    return m_fields[Field];
+                }
+                /**
+                 * @brief
+                 *
+                 * @return const char
+                 */
+                template<size_t Field>
+                char const* getString() const
+                {
+                    static_assert(Layout::isString(Field), "field is not a string");
+                    return m_strings + m_fields[Field];
+                }
+
+            private:
+                Row(unsigned int const* fields, char const* strings) : m_fields(fields), m_strings(strings) {}
+
+                unsigned int const* m_fields;   /**< TODO */
+                char const* m_strings;          /**< TODO */
+
+                friend class DBCTable;
+        };
+
+        /**
+         * @brief
+         *
+         * @param file an opened DBC file, it has to stay open while the table is used
+         */
+        explicit DBCTable(DBCFile& file) : m_file(file), m_valid(false) {}
+
+        /**
+         * @brief Checks the file against the layout
+         *
+         * @return bool false if the file does not match, the reason is printed
+         */
+        bool open()
+        {
+            m_valid = false;
+            if (!m_file.data)
+            {
+                return false;
+            }
+
+            if (m_file.fieldCount < Layout::FieldCount || m_file.recordSize != m_file.fieldCount * 4)
+            {
+                printf("%s has %u fields in %u byte records, expected at least %u fields of 4 bytes\n", Layout::Name,
+                       (unsigned int)m_file.fieldCount, (unsigned int)m_file.recordSize, (unsigned int)Layout::FieldCount);
+                return false;
+            }
+
+            // string offsets are checked here instead of on every access
+            for (size_t i = 0; i < m_file.recordCount; ++i)
+            {
+                unsigned int const* fields = getFields(i);
+                for (size_t field = 0; field < Layout::FieldCount; ++field)
+                {
+                    if (Layout::isString(field) && fields[field] >= m_file.stringSize)
+                    {
+                        printf("%s record %u has a string outside of the string table\n", Layout::Name, (unsigned int)i);
+                        return false;
+                    }
+                }
+            }
+
+            m_valid = true;
+            return true;
+        }
+
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        size_t size() const { return m_valid ? m_file.recordCount : 0; }
+        /**
+         * @brief
+         *
+         * @param row
+         * @return Row
+         */
+        Row operator[](size_t row) const
+        {
+            return Row(getFields(row), reinterpret_cast<char const*>(m_file.stringTable));
+        }
+        /**
+         * @brief Looks up a record by the id in its first field
+         *
+         * @param id
+         * @param row
+         * @return bool false if there is no such record
+         */
+        bool find(unsigned int id, Row& row) const
+        {
+            size_t index;
+            if (!m_valid || !m_file.findRow(id, index))
+            {
+                return false;
+            }
+            row = (*this)[index];
+            return true;
+        }
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        size_t getMaxId() const { return m_file.getMaxId(); }
+
+    private:
+        DBCTable(DBCTable const&);
+        DBCTable& operator=(DBCTable const&);
+
+        unsigned int const* getFields(size_t row) const
+        {
+            return reinterpret_cast<unsigned int const*>(m_file.data + row * m_file.recordSize);
+        }
+
+        DBCFile& m_file;    /**< TODO */
+        bool m_valid;       /**< TODO */
+};
+
+#endif
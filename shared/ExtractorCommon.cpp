@@ -29,10 +29,20 @@
 #include <cstring>
 #include "ExtractorCommon.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #ifdef WIN32
 #include <direct.h>
+#include <windows.h>
 #else
-#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EXTRACTOR_COMMON_SSE2
+#include <emmintrin.h>
 #endif
 
 #include <fcntl.h>
@@ -62,6 +72,33 @@
 #define OPEN_FLAGS (O_RDONLY | O_BINARY)
 #endif
 
+static const char* ExeFileName[] = { "WoW.exe", "Wow.exe", "wow.exe" ,"World of Warcraft.exe", "World of Warcraft.app/Contents/MacOS/World of Warcraft"};
+static const int iExeSpelling = 5; ///> WoW.exe (Classic, CATA), Wow.exe (TBC, MoP, WoD), wow.exe (WOTLK) and a variant
+
+/// build numbers found by getBuildNumber, kept with the size and time of the executable they were found in
+static const char* BuildCacheFileName = "extractor_build.cache";
+/// entries of other versions are searched again, version 1 could hold builds found at other positions than the old search
+static const int iBuildCacheVersion = 2;
+
+/**
+*  This function searches for the WoW exe file, using all known variations on its spelling
+*
+*  @RETURN the name of the file, or NULL if there is none
+*/
+static const char* findWoWExe()
+{
+    for (int iFileCount = 0; iFileCount < iExeSpelling; iFileCount++)
+    {
+        struct stat fileStat;
+        if (stat(ExeFileName[iFileCount], &fileStat) == 0 && (fileStat.st_mode & S_IFREG))
+        {
+            return ExeFileName[iFileCount];
+        }
+    }
+
+    return NULL;
+}
+
 /**
 *  This function searches for and opens the WoW exe file, using all known variations on its spelling
 *
@@ -69,123 +106,204 @@
 */
 FILE* openWoWExe()
 {
-    FILE *pFile;
-    const char* ExeFileName[] = { "WoW.exe", "Wow.exe", "wow.exe" ,"World of Warcraft.exe", "World of Warcraft.app/Contents/MacOS/World of Warcraft"};
-    int iExeSpelling = 5; ///> WoW.exe (Classic, CATA), Wow.exe (TBC, MoP, WoD), wow.exe (WOTLK) and a variant
+    const char* sFileName = findWoWExe();
+    if (!sFileName)
+    {
+        return 0; ///< failed to locate WoW executable
+    }
 
-    /// loop through all possible file names
-    for (int iFileCount = 0; iFileCount < iExeSpelling; iFileCount++)
+    return fopen(sFileName, "rb");
+}
+
+/**
+*  The build numbers which can be identified, as they are written in the executables
+*/
+struct BuildSignature
+{
+    const char* sText;
+    int iBuild;
+};
+
+static const BuildSignature BuildSignatures[] =
+{
+    { "5875",  5875 },  // Vanilla
+    { "6005",  6005 },  // Vanilla
+    { "6141",  6141 },  // Vanilla
+    { "8606",  8606 },  // TBC
+    { "12340", 12340 }, // WOTLK
+    { "15595", 15595 }, // CATA
+    { "18414", 18414 }  // MoP
+};
+
+/**
+*  Checks a position holding 1, 5, 6 or 8 the way the original byte by byte search did.
+*  That search only compared the digits after the first one: the 3 digits after a 5, 6
+*  or 8 with the ends of all Vanilla and TBC builds, the 4 digits after a 1 with the ends
+*  of the later builds. On a mismatch it went on after those digits, so the positions
+*  they cover are skipped.
+*
+*  @RETURN the build number, or -1 if none matches
+*/
+static int checkBuildCandidate(const unsigned char* pData, size_t iSize, size_t iPos, size_t& iNext)
+{
+    if (iPos < iNext)
     {
-#ifdef WIN32
-        if (fopen_s(&pFile, ExeFileName[iFileCount], "rb") == 0)
+        return -1;
+    }
+
+    bool bPostTBC = pData[iPos] == '1';
+    iNext = iPos + 1 + (bPostTBC ? 4 : 3);
+    for (size_t i = 0; i < sizeof(BuildSignatures) / sizeof(BuildSignatures[0]); ++i)
+    {
+        const char* sText = BuildSignatures[i].sText;
+        size_t iLength = strlen(sText);
+        if ((sText[0] == '1') == bPostTBC && iPos + iLength <= iSize &&
+            memcmp(pData + iPos + 1, sText + 1, iLength - 1) == 0)
         {
-            return pFile; ///< successfully located the WoW executable
+            return BuildSignatures[i].iBuild;
         }
-#else
-        if ((pFile = fopen(ExeFileName[iFileCount], "rb")))
+    }
+    return -1;
+}
+
+/**
+*  Searches the executable for the first known build number. All build numbers start
+*  with 1, 5, 6 or 8, only the positions holding one of them are compared, and they are
+*  matched in the same order as the original search so the same build is found.
+*
+*  @RETURN the build number, or -1 if none was found
+*/
+static int findBuildSignature(const unsigned char* pData, size_t iSize)
+{
+    size_t i = 0;
+    size_t iNext = 0; ///< first position the original search would look at
+#ifdef EXTRACTOR_COMMON_SSE2
+    const __m128i digit1 = _mm_set1_epi8('1');
+    const __m128i digit5 = _mm_set1_epi8('5');
+    const __m128i digit6 = _mm_set1_epi8('6');
+    const __m128i digit8 = _mm_set1_epi8('8');
+    for (; i + 16 <= iSize; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(pData + i));
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, digit1), _mm_cmpeq_epi8(bytes, digit5)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(bytes, digit6), _mm_cmpeq_epi8(bytes, digit8)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(found);
+        for (size_t j = 0; mask; ++j, mask >>= 1)
         {
-            return pFile; ///< successfully located the WoW executable
+            if (mask & 1)
+            {
+                int iBuild = checkBuildCandidate(pData, iSize, i + j, iNext);
+                if (iBuild >= 0)
+                {
+                    return iBuild;
+                }
+            }
         }
+    }
 #endif
+    for (; i < iSize; ++i)
+    {
+        unsigned char c = pData[i];
+        if (c == '1' || c == '5' || c == '6' || c == '8')
+        {
+            int iBuild = checkBuildCandidate(pData, iSize, i, iNext);
+            if (iBuild >= 0)
+            {
+                return iBuild;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+*  Reads the build number cached for the executable, if its size and time did not change
+*
+*  @RETURN the build number, or -1 if there is no matching entry
+*/
+static int readCachedBuildNumber(const char* sExeName, const struct stat& exeStat)
+{
+    FILE* pFile = fopen(BuildCacheFileName, "r");
+    if (!pFile)
+    {
+        return -1;
+    }
+
+    char sLine[512];
+    int iBuild = -1;
+    if (fgets(sLine, sizeof(sLine), pFile))
+    {
+        unsigned long long iSize, iTime;
+        int iVersion, iCachedBuild, iNameStart = 0;
+        if (sscanf(sLine, "v%d %llu %llu %d %n", &iVersion, &iSize, &iTime, &iCachedBuild, &iNameStart) == 4 && iNameStart > 0 &&
+            iVersion == iBuildCacheVersion)
+        {
+            std::string sName = sLine + iNameStart;
+            sName.erase(sName.find_last_not_of("\r\n") + 1);
+            if (sName == sExeName && iSize == (unsigned long long)exeStat.st_size && iTime == (unsigned long long)exeStat.st_mtime)
+            {
+                iBuild = iCachedBuild;
+            }
+        }
     }
 
-    return 0; ///< failed to locate WoW executable
+    fclose(pFile);
+    return iBuild;
+}
+
+/**
+*  Stores the build number found for the executable, failing to do so is not an error
+*/
+static void writeCachedBuildNumber(const char* sExeName, const struct stat& exeStat, int iBuild)
+{
+    FILE* pFile = fopen(BuildCacheFileName, "w");
+    if (pFile)
+    {
+        fprintf(pFile, "v%d %llu %llu %d %s\n", iBuildCacheVersion, (unsigned long long)exeStat.st_size, (unsigned long long)exeStat.st_mtime, iBuild, sExeName);
+        fclose(pFile);
+    }
 }
 
 /**
 *  This function loads up a binary file (WoW executable), then searches for and returns
-*  the build number of the file. The build number is searched for in hex form.
+*  the build number of the file. The build number is searched for in text form.
+*  The result is cached in extractor_build.cache, together with the size and time of
+*  the executable, so later runs do not have to search again.
 *
-*  @PARAM sFilename is the filename of the WoW executable to be loaded
-*  @RETURN iBuild the build number of the WoW executable, or 0 if failed
+*  @RETURN iBuild the build number of the WoW executable
 */
 int getBuildNumber()
 {
-    int iBuild = -1; ///< build version # of the WoW executable (returned value)
-
-    /// buffers used for working on the file's bytes
-    unsigned char byteSearchBuffer[1]; ///< used for reading in a single character, ready to be
-                                       ///< tested for the required text we are searching for: 1, 5, 6, or 8
-    unsigned char jumpBytesBuffer[128]; ///< used for skipping past the bytes from the file's start
-                                        ///< to the base # area, before we start searching for the base #, for faster processing
-    unsigned char preWOTLKbuildNumber[3]; ///< will hold the last 3 digits of the build number
-    unsigned char postTBCbuildNumber[4]; ///< will hold the last 4 digits of the build number
-
-    // These do not include the first digit
-    // as the first digit is used to locate the possible location of the build number
-    // then the following bytes are grabbed, 3 for pre WOTLK, 4 for WOTLK and later.
-    // Those grabbed bytes are then compared with the below variables in order to idenity the exe's build
-    unsigned char vanillaBuild1[3] = { 0x38, 0x37, 0x35 };       // (5)875
-    unsigned char vanillaBuild2[3] = { 0x30, 0x30, 0x35 };       // (6)005
-    unsigned char vanillaBuild3[3] = { 0x31, 0x34, 0x31 };       // (6)141
-    unsigned char tbcBuild[3]      = { 0x36, 0x30, 0x36 };       // (8)606
-    unsigned char wotlkBuild[4]    = { 0x32, 0x33, 0x34, 0x30 }; // (1)2340
-    unsigned char cataBuild[4]     = { 0x35, 0x35, 0x39, 0x35 }; // (1)5595
-    unsigned char mopBuild[4]      = { 0x38, 0x34, 0x31, 0x34 }; // (1)8414
-
-    FILE *pFile;
-    if (!(pFile = openWoWExe()))
+    /// the start of the file never holds the build number, skip over it
+    const size_t iSkippedBytes = 3300 * 128;
+
+    const char* sExeName = findWoWExe();
+    struct stat exeStat;
+    if (!sExeName || stat(sExeName, &exeStat) != 0)
     {
         printf("\nFatal Error: failed to locate the WoW executable!\n\n");
         printf("\nExiting program!!\n");
         exit(0); ///> failed to locate exe file
     }
 
-    /// jump over as much of the file as possible, before we start searching for the base #
-    for (int i = 0; i < 3300; i++)
+    int iBuild = readCachedBuildNumber(sExeName, exeStat);
+    if (iBuild > 0)
     {
-        fread(jumpBytesBuffer, sizeof(jumpBytesBuffer), 1, pFile);
+        return iBuild;
     }
 
-    /// Search for the build #
-    while (fread(byteSearchBuffer, 1, 1, pFile))
     {
-        /// we are looking for 1, 5, 6, or 8
-        /// these values are the first digit of the build versions we are interested in
-
-        // Vanilla and TBC
-        if (byteSearchBuffer[0] == 0x35 || byteSearchBuffer[0] == 0x36 || byteSearchBuffer[0] == 0x38)
+        MappedFile exeFile(sExeName, false);
+        if (exeFile.getSize() > iSkippedBytes)
         {
-            /// grab the next 4 bytes
-            fread(preWOTLKbuildNumber, sizeof(preWOTLKbuildNumber), 1, pFile);
-
-            if (!memcmp(preWOTLKbuildNumber, vanillaBuild1, sizeof(preWOTLKbuildNumber))) /// build is Vanilla?
-            {
-                return 5875;
-            }
-            else if (!memcmp(preWOTLKbuildNumber, vanillaBuild2, sizeof(preWOTLKbuildNumber))) /// build is Vanilla?
-            {
-                return 6005;
-            }
-            else if (!memcmp(preWOTLKbuildNumber, vanillaBuild3, sizeof(preWOTLKbuildNumber))) /// build is Vanilla?
-            {
-                return 6141;
-            }
-            else if (!memcmp(preWOTLKbuildNumber, tbcBuild, sizeof(preWOTLKbuildNumber))) /// build is TBC?
-            {
-                return 8606;
-            }
+            iBuild = findBuildSignature(exeFile.getData() + iSkippedBytes, exeFile.getSize() - iSkippedBytes);
         }
+    }
 
-        /// WOTLK, CATA, MoP
-        if (byteSearchBuffer[0] == 0x31)
-        {
-            /// grab the next 4 bytes
-            fread(postTBCbuildNumber, sizeof(postTBCbuildNumber), 1, pFile);
-
-            if (!memcmp(postTBCbuildNumber, wotlkBuild, sizeof(postTBCbuildNumber))) /// build is WOTLK?
-            {
-                return 12340;
-            }
-            else if (!memcmp(postTBCbuildNumber, cataBuild, sizeof(postTBCbuildNumber))) /// build is CATA?
-            {
-                return 15595;
-            }
-            else if (!memcmp(postTBCbuildNumber, mopBuild, sizeof(postTBCbuildNumber))) /// build is MoP?
-            {
-                return 18414;
-            }
-        }
+    if (iBuild > 0)
+    {
+        writeCachedBuildNumber(sExeName, exeStat, iBuild);
+        return iBuild;
     }
 
     printf("\nFatal Error: failed to identify build version!\n\n");
@@ -436,6 +554,140 @@ void CreateDir(const std::string& sPath)
 
 }
 
+/**
+* @Lists the files of a folder whose names end with the given suffix
+*
+* @param sPath
+* @param sSuffix
+* @param files receives the file names, without the folder
+* @return bool false if the folder can not be read
+*/
+bool ListDir(const std::string& sPath, const std::string& sSuffix, std::vector<std::string>& files)
+{
+#ifdef WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind = FindFirstFileA((sPath + "/*" + sSuffix).c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+
+    do
+    {
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            files.push_back(findData.cFileName);
+        }
+    }
+    while (FindNextFileA(hFind, &findData));
+
+    FindClose(hFind);
+#else
+    DIR* dir = opendir(sPath.c_str());
+    if (!dir)
+    {
+        return false;
+    }
+
+    while (struct dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.size() > sSuffix.size() && name.compare(name.size() - sSuffix.size(), sSuffix.size(), sSuffix) == 0)
+        {
+            files.push_back(name);
+        }
+    }
+
+    closedir(dir);
+#endif
+    return true;
+}
+
+/**
+* @Creates a hard link to an existing file
+*
+* @param sExisting
+* @param sLink must not exist yet
+* @return bool false if the file system can not link them, the caller has to copy instead
+*/
+bool LinkFile(const std::string& sExisting, const std::string& sLink)
+{
+#ifdef WIN32
+    return CreateHardLinkA(sLink.c_str(), sExisting.c_str(), NULL) != 0;
+#else
+    return link(sExisting.c_str(), sLink.c_str()) == 0;
+#endif
+}
+
+/**
+* @Maps a whole file into memory
+*
+* @param sFileName
+* @param bCopyOnWrite allow writes to the mapping, they are not written to the file
+*/
+MappedFile::MappedFile(const char* sFileName, bool bCopyOnWrite) : m_data(NULL), m_size(0)
+#ifdef WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+{
+#ifdef WIN32
+    m_file = CreateFileA(sFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+        return;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, bCopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping)
+    {
+        m_data = (unsigned char*)MapViewOfFile(m_mapping, bCopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        m_size = m_data ? size_t(size.QuadPart) : 0;
+    }
+#else
+    int fd = open(sFileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        void* data = mmap(NULL, size_t(fileStat.st_size), bCopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            m_data = (unsigned char*)data;
+            m_size = size_t(fileStat.st_size);
+        }
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef WIN32
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle((HANDLE)m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle((HANDLE)m_file);
+    }
+#else
+    if (m_data)
+    {
+        munmap(m_data, m_size);
+    }
+#endif
+}
+
 /**
 * @Checks whether the Filename in the client exists
 *
@@ -609,3 +861,23 @@ bool shouldSkipMap(int mapID,bool m_skipContinents, bool m_skipJunkMaps, bool m_
     return false;
 }
 
+
+/**
+* @brief 64 bit FNV-1a hash, pass the previous result as hash to continue
+*        hashing over several blocks
+*
+* @param data
+* @param size
+* @param hash
+* @return uint64_t
+*/
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -24,8 +24,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
 
 FILE* openWoWExe();
 int getBuildNumber();
@@ -37,9 +40,36 @@ void setMapMagicVersion(int iCoreNumber, char* magic);
 void setVMapMagicVersion(int iCoreNumber, char* magic);
 void setMMapMagicVersion(int iCoreNumber, char* magic);
 void CreateDir(const std::string& sPath);
+bool ListDir(const std::string& sPath, const std::string& sSuffix, std::vector<std::string>& files);
+bool LinkFile(const std::string& sExisting, const std::string& sLink);
 bool ClientFileExists(const char* sFileName);
 bool isTransportMap(int mapID);
 bool shouldSkipMap(int mapID, bool m_skipContinents, bool m_skipJunkMaps, bool m_skipBattlegrounds);
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+/**
+*  View of a whole file, memory mapped. getSize() is 0 if the file could not be mapped.
+*/
+class MappedFile
+{
+    public:
+        MappedFile(const char* sFileName, bool bCopyOnWrite);
+        ~MappedFile();
+
+        unsigned char* getData() const { return m_data; }
+        size_t getSize() const { return m_size; }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        unsigned char* m_data;
+        size_t m_size;
+#ifdef WIN32
+        void* m_file;
+        void* m_mapping;
+#endif
+};
 
 
 static const char *langs[12] = { "enGB", "enUS", "deDE", "esES", "frFR", "koKR", "zhCN", "zhTW", "enCN", "enTW", "esMX", "ruRU" };
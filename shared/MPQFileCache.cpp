@@ -0,0 +1,258 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "MPQFileCache.h"
+#include "ExtractorCommon.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+/**
+ * @brief A file of the cache directory
+ *
+ */
+struct CacheEntry
+{
+    uint64_t size;          /**< TODO */
+    uint64_t lastUse;       /**< position in the use order, higher is more recent */
+};
+
+static std::string cacheDirectory;                          /**< with a trailing slash, empty if closed */
+static uint64_t cacheMaxBytes = 0;                          /**< TODO */
+static uint64_t cacheBytes = 0;                             /**< TODO */
+static uint64_t cacheUseCounter = 0;                        /**< TODO */
+static std::unordered_map<uint64_t, CacheEntry> cacheEntries; /**< TODO */
+static std::mutex cacheLock;                                /**< guards the above once open */
+
+static std::atomic<uint32_t> cacheHits(0);                  /**< TODO */
+static std::atomic<uint32_t> cacheMisses(0);                /**< TODO */
+static std::atomic<uint32_t> cacheEvictions(0);             /**< TODO */
+static std::atomic<uint64_t> cacheHitBytes(0);              /**< TODO */
+
+static char const CACHE_FILE_SUFFIX[] = ".mpqc";
+
+/**
+ * @brief
+ *
+ * @param key
+ * @return std::string
+ */
+static std::string GetCacheFileName(uint64_t key)
+{
+    char name[32];
+    sprintf(name, "%016llx", (unsigned long long)key);
+    return cacheDirectory + name + CACHE_FILE_SUFFIX;
+}
+
+/**
+ * @brief Orders by last use, oldest first
+ *
+ * @param a
+ * @param b
+ * @return bool
+ */
+static bool CompareLastUse(std::pair<uint64_t, CacheEntry> const& a, std::pair<uint64_t, CacheEntry> const& b)
+{
+    return a.second.lastUse < b.second.lastUse;
+}
+
+/**
+ * @brief Removes the least recently used files until the cache is 10%
+ *        under its limit, cacheLock has to be held
+ *
+ */
+static void EvictCacheFiles()
+{
+    std::vector<std::pair<uint64_t, CacheEntry> > entries(cacheEntries.begin(), cacheEntries.end());
+    std::sort(entries.begin(), entries.end(), CompareLastUse);
+
+    uint64_t target = cacheMaxBytes - cacheMaxBytes / 10;
+    for (size_t i = 0; i < entries.size() && cacheBytes > target; ++i)
+    {
+        // a file mapped by another thread can not be removed on every system, it stays
+        if (remove(GetCacheFileName(entries[i].first).c_str()) != 0)
+        {
+            continue;
+        }
+
+        cacheBytes -= entries[i].second.size;
+        cacheEntries.erase(entries[i].first);
+        ++cacheEvictions;
+    }
+}
+
+bool MPQFileCache::open(std::string const& directory, uint64_t maxBytes)
+{
+    std::lock_guard<std::mutex> guard(cacheLock);
+
+    cacheDirectory = directory;
+    if (cacheDirectory.empty() || (cacheDirectory[cacheDirectory.size() - 1] != '/' && cacheDirectory[cacheDirectory.size() - 1] != '\\'))
+    {
+        cacheDirectory += "/";
+    }
+    CreateDir(cacheDirectory);
+
+    std::vector<std::string> files;
+    if (!ListDir(cacheDirectory, CACHE_FILE_SUFFIX, files))
+    {
+        printf("Can not use '%s' as cache directory\n", directory.c_str());
+        cacheDirectory.clear();
+        return false;
+    }
+
+    // the modification time of a file is updated when it is used, it gives
+    // the order of use of the earlier runs
+    std::vector<std::pair<time_t, std::pair<uint64_t, uint64_t> > > found;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        unsigned long long key;
+        struct stat fileStat;
+        if (sscanf(files[i].c_str(), "%16llx", &key) != 1 || stat((cacheDirectory + files[i]).c_str(), &fileStat) != 0)
+        {
+            continue;
+        }
+        found.push_back(std::make_pair(fileStat.st_mtime, std::make_pair(uint64_t(key), uint64_t(fileStat.st_size))));
+    }
+    std::sort(found.begin(), found.end());
+
+    cacheEntries.clear();
+    cacheBytes = 0;
+    cacheUseCounter = 0;
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        CacheEntry entry;
+        entry.size = found[i].second.second;
+        entry.lastUse = ++cacheUseCounter;
+        cacheEntries[found[i].second.first] = entry;
+        cacheBytes += entry.size;
+    }
+
+    cacheMaxBytes = maxBytes;
+    if (cacheBytes > cacheMaxBytes)
+    {
+        EvictCacheFiles();
+    }
+
+    printf(" Using cache '%s', %u files, %.1f of %.1f MB\n", cacheDirectory.c_str(), uint32_t(cacheEntries.size()),
+           cacheBytes / 1048576.0, cacheMaxBytes / 1048576.0);
+    return true;
+}
+
+bool MPQFileCache::isOpen()
+{
+    return !cacheDirectory.empty();
+}
+
+MappedFile* MPQFileCache::find(uint64_t key)
+{
+    std::string filename = GetCacheFileName(key);
+    {
+        std::lock_guard<std::mutex> guard(cacheLock);
+        std::unordered_map<uint64_t, CacheEntry>::iterator itr = cacheEntries.find(key);
+        if (itr == cacheEntries.end())
+        {
+            ++cacheMisses;
+            return NULL;
+        }
+        itr->second.lastUse = ++cacheUseCounter;
+    }
+
+    // buffers of archive files may be changed by their readers, the mapping copies on write
+    MappedFile* file = new MappedFile(filename.c_str(), true);
+    if (!file->getSize())
+    {
+        delete file;
+        ++cacheMisses;
+        return NULL;
+    }
+
+    utime(filename.c_str(), NULL);
+    ++cacheHits;
+    cacheHitBytes += file->getSize();
+    return file;
+}
+
+void MPQFileCache::store(uint64_t key, char const* data, size_t size)
+{
+    std::string filename = GetCacheFileName(key);
+
+    // written under a name of its own first, so no reader maps a partial file
+    char suffix[32];
+    sprintf(suffix, ".%llx.tmp", (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string tempName = filename + suffix;
+
+    FILE* output = fopen(tempName.c_str(), "wb");
+    if (!output)
+    {
+        return;
+    }
+    bool written = fwrite(data, size, 1, output) == 1;
+    if (fclose(output) != 0 || !written)
+    {
+        remove(tempName.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    remove(filename.c_str());
+    if (rename(tempName.c_str(), filename.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        return;
+    }
+
+    CacheEntry& entry = cacheEntries[key];
+    cacheBytes += size - entry.size;
+    entry.size = size;
+    entry.lastUse = ++cacheUseCounter;
+    if (cacheBytes > cacheMaxBytes)
+    {
+        EvictCacheFiles();
+    }
+}
+
+void MPQFileCache::printSummary()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    printf(" Cache: %u hits (%.1f MB not decompressed), %u misses, %u files evicted, %.1f MB in use\n",
+           uint32_t(cacheHits), cacheHitBytes / 1048576.0, uint32_t(cacheMisses), uint32_t(cacheEvictions), cacheBytes / 1048576.0);
+}
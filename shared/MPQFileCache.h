@@ -0,0 +1,85 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef MPQ_FILE_CACHE_H
+#define MPQ_FILE_CACHE_H
+
+#include <stdint.h>
+#include <string>
+
+class MappedFile;
+
+/**
+ * @brief Directory of decompressed archive files, shared by the extractors
+ *
+ * A file is stored under a hash of its name and of the archive it was read
+ * from, by name, size and modification time. So every extractor finds it
+ * again, whatever other archives it opened. Files are mapped instead of
+ * decompressed on a hit. Once the directory grows over its size limit the
+ * least recently used files are removed.
+ *
+ * All functions may be called from any thread once the cache is open.
+ */
+class MPQFileCache
+{
+    public:
+        /**
+         * @brief Uses the directory as cache for the rest of the run
+         *
+         * @param directory created if needed
+         * @param maxBytes size limit of the directory
+         * @return bool
+         */
+        static bool open(std::string const& directory, uint64_t maxBytes);
+        /**
+         * @brief
+         *
+         * @return bool
+         */
+        static bool isOpen();
+
+        /**
+         * @brief Maps a cached file
+         *
+         * @param key
+         * @return MappedFile NULL on a miss, the caller deletes it
+         */
+        static MappedFile* find(uint64_t key);
+        /**
+         * @brief Stores a file read after a miss
+         *
+         * @param key
+         * @param data
+         * @param size
+         */
+        static void store(uint64_t key, char const* data, size_t size);
+
+        /**
+         * @brief Prints the hits, misses and evictions of the run
+         *
+         */
+        static void printSummary();
+};
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "MPQFileIndex.h"
+
+#include <algorithm>
+#include <ml/mpq.h>
+
+extern ArchiveSet gOpenArchives;
+
+MPQFileIndex gFileIndex;
+
+std::string MPQFileIndex::normalize(std::string const& name)
+{
+    std::string normalized = name;
+    for (size_t i = 0; i < normalized.size(); ++i)
+    {
+        char c = normalized[i];
+        if (c == '/')
+        {
+            normalized[i] = '\\';
+        }
+        else if (c >= 'A' && c <= 'Z')
+        {
+            normalized[i] = c - 'A' + 'a';
+        }
+    }
+    return normalized;
+}
+
+/**
+ * @brief Extension of a normalized name, with the dot
+ *
+ * @param name
+ * @return std::string empty if there is none
+ */
+static std::string GetNormalizedExtension(std::string const& name)
+{
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || name.find('\\', dot) != std::string::npos)
+    {
+        return std::string();
+    }
+    return name.substr(dot);
+}
+
+void MPQFileIndex::build()
+{
+    clear();
+
+    // gOpenArchives starts with the archive of the highest priority, so the
+    // first archive holding a name is the one MPQFile reads it from
+    std::unordered_map<std::string, MPQFileIndexEntry> files;
+    uint32_t archive = 0;
+    for (ArchiveSet::const_iterator itr = gOpenArchives.begin(); itr != gOpenArchives.end(); ++itr, ++archive)
+    {
+        std::vector<std::string> names;
+        (*itr)->GetFileListTo(names);
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            std::string normalized = normalize(names[i]);
+            if (files.find(normalized) != files.end())
+            {
+                continue;
+            }
+
+            // a listed file may be missing from the archive itself
+            uint32_t fileNumber;
+            if (libmpq__file_number((*itr)->mpq_a, names[i].c_str(), &fileNumber))
+            {
+                continue;
+            }
+
+            MPQFileIndexEntry entry;
+            libmpq__off_t offset = 0, packedSize = 0, size = 0;
+            uint32_t compressed = 0;
+            libmpq__file_offset((*itr)->mpq_a, fileNumber, &offset);
+            libmpq__file_packed_size((*itr)->mpq_a, fileNumber, &packedSize);
+            libmpq__file_unpacked_size((*itr)->mpq_a, fileNumber, &size);
+            libmpq__file_compressed((*itr)->mpq_a, fileNumber, &compressed);
+
+            entry.name = names[i];
+            entry.archive = archive;
+            entry.fileNumber = fileNumber;
+            entry.offset = uint64_t(offset);
+            entry.packedSize = uint64_t(packedSize);
+            entry.size = uint64_t(size);
+            entry.compressed = compressed != 0;
+            files.insert(std::make_pair(normalized, entry));
+        }
+    }
+
+    m_names.reserve(files.size());
+    for (std::unordered_map<std::string, MPQFileIndexEntry>::const_iterator itr = files.begin(); itr != files.end(); ++itr)
+    {
+        m_names.push_back(itr->first);
+    }
+    std::sort(m_names.begin(), m_names.end());
+
+    m_files.reserve(m_names.size());
+    m_byName.reserve(m_names.size());
+    for (uint32_t i = 0; i < m_names.size(); ++i)
+    {
+        m_files.push_back(files[m_names[i]]);
+        m_byName[m_names[i]] = i;
+        m_byExtension[GetNormalizedExtension(m_names[i])].push_back(i);
+    }
+}
+
+void MPQFileIndex::clear()
+{
+    m_files.clear();
+    m_names.clear();
+    m_byName.clear();
+    m_byExtension.clear();
+}
+
+MPQFileIndexEntry const* MPQFileIndex::find(std::string const& name) const
+{
+    std::unordered_map<std::string, uint32_t>::const_iterator itr = m_byName.find(normalize(name));
+    return itr != m_byName.end() ? &m_files[itr->second] : NULL;
+}
+
+void MPQFileIndex::findByExtension(std::string const& extension, EntryList& files) const
+{
+    std::unordered_map<std::string, std::vector<uint32_t> >::const_iterator itr = m_byExtension.find(normalize(extension));
+    if (itr == m_byExtension.end())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < itr->second.size(); ++i)
+    {
+        files.push_back(&m_files[itr->second[i]]);
+    }
+}
+
+void MPQFileIndex::findByPrefix(std::string const& prefix, EntryList& files) const
+{
+    std::string normalized = normalize(prefix);
+    std::vector<std::string>::const_iterator itr = std::lower_bound(m_names.begin(), m_names.end(), normalized);
+    for (; itr != m_names.end() && itr->compare(0, normalized.size(), normalized) == 0; ++itr)
+    {
+        files.push_back(&m_files[itr - m_names.begin()]);
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef MPQ_FILE_INDEX_H
+#define MPQ_FILE_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * @brief A file of the open archives, as MPQFile would read it
+ *
+ */
+struct MPQFileIndexEntry
+{
+    std::string name;           /**< as listed by the archive */
+    uint32_t archive;           /**< index into gOpenArchives */
+    uint32_t fileNumber;        /**< TODO */
+    uint64_t offset;            /**< of the file in its archive */
+    uint64_t packedSize;        /**< TODO */
+    uint64_t size;              /**< TODO */
+    bool compressed;            /**< TODO */
+};
+
+/**
+ * @brief All files of gOpenArchives, each in the archive MPQFile reads it
+ *        from, which is the first archive holding it
+ *
+ * Names are matched without case and with either kind of slash. The index
+ * has to be built again whenever archives are opened or closed.
+ */
+class MPQFileIndex
+{
+    public:
+        typedef std::vector<MPQFileIndexEntry const*> EntryList;
+
+        /**
+         * @brief Lists the files of all open archives
+         *
+         */
+        void build();
+        /**
+         * @brief
+         *
+         */
+        void clear();
+
+        /**
+         * @brief
+         *
+         * @param name
+         * @return const MPQFileIndexEntry NULL if no archive holds the file
+         */
+        MPQFileIndexEntry const* find(std::string const& name) const;
+        /**
+         * @brief Files whose name ends with the extension, such as ".wmo"
+         *
+         * @param extension
+         * @param files receives the files sorted by name
+         */
+        void findByExtension(std::string const& extension, EntryList& files) const;
+        /**
+         * @brief Files whose name starts with the prefix, such as
+         *        "World\\Maps\\Azeroth\\"
+         *
+         * @param prefix
+         * @param files receives the files sorted by name
+         */
+        void findByPrefix(std::string const& prefix, EntryList& files) const;
+
+        /**
+         * @brief
+         *
+         * @return const std::vector<MPQFileIndexEntry> all files sorted by name
+         */
+        std::vector<MPQFileIndexEntry> const& getFiles() const { return m_files; }
+
+        /**
+         * @brief Lower case with backslashes, the form names are compared in
+         *
+         * @param name
+         * @return std::string
+         */
+        static std::string normalize(std::string const& name);
+
+    private:
+        std::vector<MPQFileIndexEntry> m_files;                     /**< sorted by normalized name */
+        std::vector<std::string> m_names;                           /**< normalized names of m_files */
+        std::unordered_map<std::string, uint32_t> m_byName;         /**< normalized name to m_files index */
+        std::unordered_map<std::string, std::vector<uint32_t> > m_byExtension; /**< TODO */
+};
+
+extern MPQFileIndex gFileIndex; /**< index of gOpenArchives shared by the extractors */
+
+#endif
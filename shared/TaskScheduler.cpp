@@ -0,0 +1,292 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "TaskScheduler.h"
+
+#include <chrono>
+
+static thread_local TaskScheduler* currentScheduler = NULL;   /**< scheduler of the calling worker */
+static thread_local int currentWorkerIndex = -1;              /**< TODO */
+static thread_local Task* currentTask = NULL;                 /**< task running on the calling thread */
+
+bool Task::isCancelled() const
+{
+    return m_group && m_group->isCancelled();
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler) :
+    m_scheduler(scheduler), m_parent(currentTask ? currentTask->m_group : NULL),
+    m_pending(0), m_cancelled(false)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+bool TaskGroup::isCancelled() const
+{
+    return m_cancelled || (m_parent && m_parent->isCancelled());
+}
+
+void TaskGroup::run(Task* task)
+{
+    task->m_group = this;
+    ++m_pending;
+    m_scheduler.submit(task);
+}
+
+void TaskGroup::wait()
+{
+    if (m_scheduler.currentWorker() < 0)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_pending > 0)
+        {
+            m_done.wait(lock);
+        }
+        return;
+    }
+
+    // a worker keeps running queued tasks, its own subtasks are likely among them
+    while (m_pending > 0)
+    {
+        if (!m_scheduler.runPending())
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_pending > 0)
+            {
+                m_done.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // the last taskDone may still hold the lock, the group must outlive it
+    std::lock_guard<std::mutex> lock(m_mutex);
+}
+
+void TaskGroup::cancel()
+{
+    m_cancelled = true;
+}
+
+void TaskGroup::taskDone()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0)
+    {
+        m_done.notify_all();
+    }
+}
+
+TaskScheduler::TaskScheduler(int threads) :
+    m_queued(0), m_nextWorker(0), m_stopping(false)
+{
+    if (threads <= 0)
+    {
+        threads = getDefaultThreadCount();
+    }
+
+    // all deques exist before the first worker starts looking for work
+    for (int i = 0; i < threads; ++i)
+    {
+        m_workers.push_back(new Worker);
+    }
+    for (int i = 0; i < threads; ++i)
+    {
+        m_workers[i]->thread = std::thread(TaskScheduler::workerMain, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i]->thread.join();
+    }
+
+    // whatever is left is dropped so that waiting groups are released
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        for (int priority = 0; priority < TASK_PRIORITY_COUNT; ++priority)
+        {
+            std::deque<Task*>& queue = m_workers[i]->queues[priority];
+            while (!queue.empty())
+            {
+                Task* task = queue.front();
+                queue.pop_front();
+                TaskGroup* group = task->m_group;
+                delete task;
+                group->taskDone();
+            }
+        }
+        delete m_workers[i];
+    }
+    m_workers.clear();
+}
+
+int TaskScheduler::getDefaultThreadCount()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores ? int(cores) : 1;
+}
+
+void TaskScheduler::submit(Task* task)
+{
+    if (m_stopping)
+    {
+        TaskGroup* group = task->m_group;
+        delete task;
+        group->taskDone();
+        return;
+    }
+
+    int index = currentWorker();
+    if (index < 0)
+    {
+        index = int(m_nextWorker++ % m_workers.size());
+    }
+
+    Worker* worker = m_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->queues[task->getPriority()].push_back(task);
+        ++m_queued;
+    }
+
+    // taking the lock orders this against a worker about to go to sleep
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeUp.notify_one();
+}
+
+Task* TaskScheduler::take(int self)
+{
+    if (m_queued == 0)
+    {
+        return NULL;
+    }
+
+    int count = int(m_workers.size());
+    for (int priority = TASK_PRIORITY_COUNT - 1; priority >= 0; --priority)
+    {
+        if (self >= 0)
+        {
+            Worker* worker = m_workers[self];
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            std::deque<Task*>& queue = worker->queues[priority];
+            if (!queue.empty())
+            {
+                Task* task = queue.back();
+                queue.pop_back();
+                --m_queued;
+                return task;
+            }
+        }
+
+        for (int i = 1; i <= count; ++i)
+        {
+            int victim = ((self < 0 ? 0 : self) + i) % count;
+            if (victim == self)
+            {
+                continue;
+            }
+
+            Worker* worker = m_workers[victim];
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            std::deque<Task*>& queue = worker->queues[priority];
+            if (!queue.empty())
+            {
+                Task* task = queue.front();
+                queue.pop_front();
+                --m_queued;
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+void TaskScheduler::execute(Task* task)
+{
+    TaskGroup* group = task->m_group;
+    if (!group->isCancelled())
+    {
+        Task* outerTask = currentTask;
+        currentTask = task;
+        task->run();
+        currentTask = outerTask;
+    }
+
+    delete task;
+    group->taskDone();
+}
+
+bool TaskScheduler::runPending()
+{
+    Task* task = take(currentWorker());
+    if (!task)
+    {
+        return false;
+    }
+
+    execute(task);
+    return true;
+}
+
+int TaskScheduler::currentWorker() const
+{
+    return currentScheduler == this ? currentWorkerIndex : -1;
+}
+
+void TaskScheduler::workerMain(TaskScheduler* scheduler, int index)
+{
+    currentScheduler = scheduler;
+    currentWorkerIndex = index;
+
+    while (!scheduler->m_stopping)
+    {
+        if (scheduler->runPending())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(scheduler->m_sleepMutex);
+        while (scheduler->m_queued == 0 && !scheduler->m_stopping)
+        {
+            scheduler->m_wakeUp.wait(lock);
+        }
+    }
+
+    currentScheduler = NULL;
+    currentWorkerIndex = -1;
+}
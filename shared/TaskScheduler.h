@@ -0,0 +1,296 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+class TaskScheduler;
+
+/**
+ * @brief Order in which queued tasks are picked up, higher first
+ *
+ */
+enum TaskPriority
+{
+    TASK_PRIORITY_LOW       = 0,
+    TASK_PRIORITY_NORMAL    = 1,
+    TASK_PRIORITY_HIGH      = 2,
+    TASK_PRIORITY_COUNT     = 3
+};
+
+/**
+ * @brief A unit of work run by a TaskScheduler
+ *
+ * Tasks are handed to a TaskGroup, which owns them from then on. The
+ * scheduler deletes a task after it has run, or without running it when its
+ * group was cancelled before a worker got to it.
+ */
+class Task
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param priority
+         */
+        explicit Task(TaskPriority priority = TASK_PRIORITY_NORMAL) :
+            m_priority(priority), m_group(NULL)
+        {
+        }
+
+        /**
+         * @brief
+         *
+         */
+        virtual ~Task() {}
+
+        /**
+         * @brief Does the work, called once on one of the worker threads
+         *
+         */
+        virtual void run() = 0;
+
+        /**
+         * @brief
+         *
+         * @return TaskPriority
+         */
+        TaskPriority getPriority() const { return m_priority; }
+
+        /**
+         * @brief Long running tasks should check this now and then and return
+         *        early once their group was cancelled
+         *
+         * @return bool
+         */
+        bool isCancelled() const;
+
+    private:
+        friend class TaskGroup;
+        friend class TaskScheduler;
+
+        Task(Task const&);
+        Task& operator=(Task const&);
+
+        TaskPriority m_priority;    /**< TODO */
+        TaskGroup* m_group;         /**< TODO */
+};
+
+/**
+ * @brief Set of tasks which can be waited for or cancelled together
+ *
+ * Groups can be created from inside a running task to split its work further.
+ * A worker waiting for such a nested group keeps running queued tasks in the
+ * meantime, so nesting does not take threads away from the scheduler and can
+ * not deadlock it.
+ */
+class TaskGroup
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param scheduler
+         */
+        explicit TaskGroup(TaskScheduler& scheduler);
+
+        /**
+         * @brief Waits for the tasks still pending
+         *
+         */
+        ~TaskGroup();
+
+        /**
+         * @brief Queues a task, the group takes ownership of it
+         *
+         * @param task
+         */
+        void run(Task* task);
+
+        /**
+         * @brief Blocks until all tasks of the group have run or were dropped
+         *
+         */
+        void wait();
+
+        /**
+         * @brief Drops the tasks which did not start yet and flags running
+         *        ones through Task::isCancelled, call wait() afterwards.
+         *        Groups created by tasks of this group are cancelled too.
+         *
+         */
+        void cancel();
+
+        /**
+         * @brief
+         *
+         * @return bool
+         */
+        bool isCancelled() const;
+
+        /**
+         * @brief
+         *
+         * @return TaskScheduler
+         */
+        TaskScheduler& getScheduler() const { return m_scheduler; }
+
+    private:
+        friend class TaskScheduler;
+
+        TaskGroup(TaskGroup const&);
+        TaskGroup& operator=(TaskGroup const&);
+
+        /**
+         * @brief Called by the scheduler once a task of the group is done
+         *
+         */
+        void taskDone();
+
+        TaskScheduler& m_scheduler;         /**< TODO */
+        TaskGroup* m_parent;                /**< group of the task which created this one */
+        std::atomic<int> m_pending;         /**< tasks queued or running */
+        std::atomic<bool> m_cancelled;      /**< TODO */
+        std::mutex m_mutex;                 /**< TODO */
+        std::condition_variable m_done;     /**< TODO */
+};
+
+/**
+ * @brief Fixed set of worker threads running tasks of any extractor
+ *
+ * Every worker has its own deque per priority. Tasks queued by a worker go to
+ * its own deques and are taken back newest first, which keeps nested work on
+ * the thread that has its data in cache. Tasks queued from other threads are
+ * spread over the workers. An idle worker steals the oldest task of another
+ * worker, and sleeps when there is nothing left anywhere.
+ */
+class TaskScheduler
+{
+    public:
+        /**
+         * @brief Starts the workers
+         *
+         * @param threads number of workers, 0 or less for one per CPU core
+         */
+        explicit TaskScheduler(int threads);
+
+        /**
+         * @brief Drops the tasks still queued and joins the workers
+         *
+         */
+        ~TaskScheduler();
+
+        /**
+         * @brief
+         *
+         * @return int
+         */
+        int getThreadCount() const { return int(m_workers.size()); }
+
+        /**
+         * @brief Number of CPU cores, used when no thread count is given
+         *
+         * @return int
+         */
+        static int getDefaultThreadCount();
+
+    private:
+        friend class TaskGroup;
+
+        /**
+         * @brief
+         *
+         */
+        struct Worker
+        {
+            std::mutex mutex;                                   /**< TODO */
+            std::deque<Task*> queues[TASK_PRIORITY_COUNT];      /**< TODO */
+            std::thread thread;                                 /**< TODO */
+        };
+
+        TaskScheduler(TaskScheduler const&);
+        TaskScheduler& operator=(TaskScheduler const&);
+
+        /**
+         * @brief
+         *
+         * @param task
+         */
+        void submit(Task* task);
+
+        /**
+         * @brief Takes a task of the highest priority available, from the
+         *        own deque first and stolen from the others otherwise
+         *
+         * @param self index of the calling worker, -1 for other threads
+         * @return Task NULL if there is no queued task
+         */
+        Task* take(int self);
+
+        /**
+         * @brief Runs a taken task, or drops it if its group was cancelled
+         *
+         * @param task
+         */
+        void execute(Task* task);
+
+        /**
+         * @brief Runs one queued task if there is one
+         *
+         * @return bool
+         */
+        bool runPending();
+
+        /**
+         * @brief
+         *
+         * @return int index of the calling thread, -1 if it is not a worker
+         */
+        int currentWorker() const;
+
+        /**
+         * @brief
+         *
+         * @param scheduler
+         * @param index
+         */
+        static void workerMain(TaskScheduler* scheduler, int index);
+
+        std::vector<Worker*> m_workers;     /**< TODO */
+        std::atomic<int> m_queued;          /**< tasks in all deques */
+        std::atomic<unsigned> m_nextWorker; /**< round robin for tasks from other threads */
+        std::atomic<bool> m_stopping;       /**< TODO */
+        std::mutex m_sleepMutex;            /**< TODO */
+        std::condition_variable m_wakeUp;   /**< TODO */
+};
+
+#endif
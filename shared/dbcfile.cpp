@@ -25,111 +25,114 @@
 #include "dbcfile.h"
 #undef min
 #undef max
-#include <ml/mpq.h>
+#include "ConcurrentMPQ.h"
 
 #include <cstdio>
 
+/**
+ * @brief Layout of the start of a DBC file
+ *
+ */
+struct DBCFileHeader
+{
+    char magic[4];              /**< WDBC */
+    unsigned int recordCount;   /**< TODO */
+    unsigned int fieldCount;    /**< TODO */
+    unsigned int recordSize;    /**< TODO */
+    unsigned int stringSize;    /**< TODO */
+};
+
 DBCFile::DBCFile(const std::string& filename):
     filename(filename),
-    data(0)
+    file(NULL),
+    data(0),
+    maxId(0),
+    indexBuilt(false)
 {
 
 }
 bool DBCFile::open()
 {
-    MPQFile f(filename.c_str());
+    close();
+
+    // The records and strings are used where the file was decompressed or mapped,
+    // the file is kept open for as long as this DBCFile
+    file = new ConcurrentMPQFile(filename.c_str());
 
     // Need some error checking, otherwise an unhandled exception error occurs
     // if people screw with the data path.
-    if (f.isEof() == true)
+    if (file->isEof() == true)
     {
-        f.close();
-        data = NULL;
+        close();
         printf("Could not open DBCFile %s.\n", filename.c_str());
         return false;
     }
 
-    unsigned char header[4];
-    unsigned int na, nb, es, ss;
-
-    if (f.read(header, 4) != 4)                             // Number of records
+    if (file->getSize() < sizeof(DBCFileHeader))
     {
-        f.close();
-        data = NULL;
+        close();
         printf("Could not read header in DBCFile %s.\n", filename.c_str());
         return false;
     }
 
-    if (header[0] != 'W' || header[1] != 'D' || header[2] != 'B' || header[3] != 'C')
+    DBCFileHeader const* header = reinterpret_cast<DBCFileHeader const*>(file->getBuffer());
+    if (header->magic[0] != 'W' || header->magic[1] != 'D' || header->magic[2] != 'B' || header->magic[3] != 'C')
     {
-        f.close();
-        data = NULL;
+        close();
         printf("The header in DBCFile %s did not match.\n", filename.c_str());
         return false;
     }
 
-    if (f.read(&na, 4) != 4)                                // Number of records
-    {
-        f.close();
-        data = NULL;
-        printf("Could not read number of records from DBCFile %s.\n", filename.c_str());
-        return false;
-    }
-
-    if (f.read(&nb, 4) != 4)                                // Number of fields
-    {
-        f.close();
-        data = NULL;
-        printf("Could not read number of fields from DBCFile %s.\n", filename.c_str());
-        return false;
-    }
-
-    if (f.read(&es, 4) != 4)                                // Size of a record
-    {
-        f.close();
-        data = NULL;
-        printf("Could not read record size from DBCFile %s.\n", filename.c_str());
-        return false;
-    }
-
-    if (f.read(&ss, 4) != 4)                                // String size
-    {
-        f.close();
-        data = NULL;
-        printf("Could not read string block size from DBCFile %s.\n", filename.c_str());
-        return false;
-    }
-
-    recordSize = es;
-    recordCount = na;
-    fieldCount = nb;
-    stringSize = ss;
+    recordSize = header->recordSize;
+    recordCount = header->recordCount;
+    fieldCount = header->fieldCount;
+    stringSize = header->stringSize;
     if (fieldCount * 4 != recordSize)
     {
-        f.close();
-        data = NULL;
+        close();
         printf("Field count and record size in DBCFile %s do not match.\n", filename.c_str());
         return false;
     }
 
-    data = new unsigned char[recordSize * recordCount + stringSize];
-    stringTable = data + recordSize * recordCount;
-
     size_t data_size = recordSize * recordCount + stringSize;
-    if (f.read(data, data_size) != data_size)
+    if (file->getSize() - sizeof(DBCFileHeader) < data_size)
     {
-        f.close();
-        data = NULL;
+        close();
         printf("DBCFile %s did not contain expected amount of data for records.\n", filename.c_str());
         return false;
     }
 
-    f.close();
+    data = reinterpret_cast<unsigned char*>(file->getBuffer()) + sizeof(DBCFileHeader);
+    stringTable = data + recordSize * recordCount;
+
+    maxId = 0;
+    for (size_t i = 0; i < recordCount; ++i)
+    {
+        size_t id = getRecord(i).getUInt(0);
+        if (maxId < id)
+        {
+            maxId = id;
+        }
+    }
     return true;
 }
+
+void DBCFile::close()
+{
+    // the records live in the buffer of the file
+    delete file;
+    file = NULL;
+    data = NULL;
+    maxId = 0;
+
+    indexBuilt = false;
+    denseIndex.clear();
+    sparseIndex.clear();
+}
+
 DBCFile::~DBCFile()
 {
-    delete [] data;
+    close();
 }
 
 DBCFile::Record DBCFile::getRecord(size_t id)
@@ -138,19 +141,65 @@ DBCFile::Record DBCFile::getRecord(size_t id)
     return Record(*this, data + id * recordSize);
 }
 
-size_t DBCFile::getMaxId()
+bool DBCFile::findRow(unsigned int id, size_t& row)
 {
     assert(data);
 
-    size_t maxId = 0;
-    for (size_t i = 0; i < getRecordCount(); ++i)
+    if (!indexBuilt)
+    {
+        indexBuilt = true;
+        // ids mostly count up from 1, allow some gaps before using a hash
+        if (maxId < recordCount * 4 + 256)
+        {
+            denseIndex.assign(maxId + 1, 0);
+            for (size_t i = 0; i < recordCount; ++i)
+            {
+                denseIndex[getRecord(i).getUInt(0)] = (unsigned int)(i + 1);
+            }
+        }
+        else
+        {
+            sparseIndex.reserve(recordCount);
+            for (size_t i = 0; i < recordCount; ++i)
+            {
+                sparseIndex[getRecord(i).getUInt(0)] = (unsigned int)i;
+            }
+        }
+    }
+
+    if (!denseIndex.empty())
     {
-        if (maxId < getRecord(i).getUInt(0))
+        if (id >= denseIndex.size() || !denseIndex[id])
         {
-            maxId = getRecord(i).getUInt(0);
+            return false;
         }
+        row = denseIndex[id] - 1;
+        return true;
     }
-    return maxId;
+
+    std::unordered_map<unsigned int, unsigned int>::const_iterator itr = sparseIndex.find(id);
+    if (itr == sparseIndex.end())
+    {
+        return false;
+    }
+    row = itr->second;
+    return true;
+}
+
+DBCFile::Record DBCFile::getRecordById(unsigned int id)
+{
+    size_t row;
+    if (!findRow(id, row))
+    {
+        throw NotFound();
+    }
+    return getRecord(row);
+}
+
+bool DBCFile::hasRecordWithId(unsigned int id)
+{
+    size_t row;
+    return findRow(id, row);
 }
 
 DBCFile::Iterator DBCFile::begin()
@@ -27,6 +27,10 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
+#include <unordered_map>
+
+class ConcurrentMPQFile;
 
 /**
  * @brief
@@ -50,9 +54,17 @@ class DBCFile
         /**
          * @brief Open database. It must be openened before it can be used.
          *
+         * Records point straight into the decompressed file, which stays
+         * loaded until the database is closed.
+         *
          * @return bool
          */
         bool open();
+        /**
+         * @brief Releases the file, records and iterators become invalid
+         *
+         */
+        void close();
 
         /**
          * @brief Database exceptions
@@ -254,12 +266,31 @@ class DBCFile
         };
 
         /**
-         * @brief Get record by id
+         * @brief Get record by its row
          *
          * @param id
          * @return Record
          */
         Record getRecord(size_t id);
+        /**
+         * @brief Get record by the id in its first field
+         *
+         * The id index is built on the first lookup, as a table when the ids
+         * are compact and as a hash otherwise. With duplicate ids the last
+         * row wins.
+         *
+         * @param id
+         * @return Record
+         * @throws NotFound
+         */
+        Record getRecordById(unsigned int id);
+        /**
+         * @brief
+         *
+         * @param id
+         * @return bool
+         */
+        bool hasRecordWithId(unsigned int id);
         /**
          * @brief Get begin iterator over records
          *
@@ -285,19 +316,38 @@ class DBCFile
          */
         size_t getFieldCount() const { return fieldCount; }
         /**
-         * @brief
+         * @brief Largest id in the first field, found when opening
          *
          * @return size_t
          */
-        size_t getMaxId();
+        size_t getMaxId() const { return maxId; }
     private:
+        /**
+         * @brief
+         *
+         * @param id
+         * @param row
+         * @return bool false if no record has the id
+         */
+        bool findRow(unsigned int id, size_t& row);
+        DBCFile(const DBCFile&);
+        DBCFile& operator=(const DBCFile&);
+
+        template<class Layout> friend class DBCTable;
+
         std::string filename; /**< TODO */
+        ConcurrentMPQFile* file; /**< holds the decompressed file data points into */
         size_t recordSize; /**< TODO */
         size_t recordCount; /**< TODO */
         size_t fieldCount; /**< TODO */
         size_t stringSize; /**< TODO */
         unsigned char* data; /**< TODO */
         unsigned char* stringTable; /**< TODO */
+        size_t maxId; /**< TODO */
+
+        bool indexBuilt; /**< TODO */
+        std::vector<unsigned int> denseIndex; /**< row + 1 by id, 0 for unused ids */
+        std::unordered_map<unsigned int, unsigned int> sparseIndex; /**< row by id */
 };
 
 #endif
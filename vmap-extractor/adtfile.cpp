@@ -32,7 +32,7 @@ ADTFile::ADTFile(char* filename): ADT(filename)
     AdtFilename.assign(filename);
 }
 
-bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failedPaths,int iCoreNumber, const void *szRawVMAPMagic)
+bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failedPaths,int iCoreNumber, const void *szRawVMAPMagic, DirFileBuffer& dirData)
 {
     if (ADT.isEof())
     {
@@ -54,15 +54,6 @@ bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failed
 
     std::string AdtMapNumber = xMap + ' ' + yMap + ' ' + GetUniformName(AdtFilename);
 
-    std::string dirname = std::string(szWorkDirWmo) + "/dir_bin";
-    FILE* dirfile;
-    dirfile = fopen(dirname.c_str(), "ab");
-    if (!dirfile)
-    {
-        printf("Can't open dirfile!'%s'\n", dirname.c_str());
-        return false;
-    }
-
     while (!ADT.isEof())
     {
         char fourcc[5];
@@ -127,7 +118,7 @@ bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failed
                 {
                     uint32 id;
                     ADT.read(&id, 4);
-                    ModelInstance inst(ADT, ModelInstansName[id], map_num, tileX, tileY, dirfile, iCoreNumber);
+                    ModelInstance inst(ADT, ModelInstansName[id], map_num, tileX, tileY, dirData, iCoreNumber);
                 }
                 delete[] ModelInstansName;
             }
@@ -141,7 +132,7 @@ bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failed
                 {
                     uint32 id;
                     ADT.read(&id, 4);
-                    WMOInstance inst(ADT, WmoInstansName[id], map_num, tileX, tileY, dirfile);
+                    WMOInstance inst(ADT, WmoInstansName[id], map_num, tileX, tileY, dirData);
                 }
                 delete[] WmoInstansName;
             }
@@ -150,7 +141,6 @@ bool ADTFile::init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failed
         ADT.seek(nextpos);
     }
     ADT.close();
-    fclose(dirfile);
 
     return true;
 }
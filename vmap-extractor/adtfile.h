@@ -168,11 +168,12 @@ class ADTFile
          * @param tileX
          * @param tileY
          * @param failedPaths
+         * @param dirData receives the placements of the tile
          * @return bool
          */
-        bool init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failedPaths,int iCoreNumber, const void *szRawVMAPMagic);
+        bool init(uint32 map_num, uint32 tileX, uint32 tileY, StringSet& failedPaths,int iCoreNumber, const void *szRawVMAPMagic, DirFileBuffer& dirData);
     private:
-        MPQFile ADT; /**< TODO */
+        ConcurrentMPQFile ADT; /**< TODO */
         string AdtFilename; /**< TODO */
 };
 
@@ -0,0 +1,197 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "dirfile.h"
+
+#include <algorithm>
+#include <cstring>
+
+static size_t const DIR_WRITE_BUFFER_SIZE = 4 * 1024 * 1024; /**< TODO */
+
+/**
+ * @brief Orders index entries by map and tile
+ *
+ * @param a
+ * @param b
+ * @return bool
+ */
+static bool DirIndexEntryLess(dir_indexEntry const& a, dir_indexEntry const& b)
+{
+    if (a.mapId != b.mapId)
+    {
+        return a.mapId < b.mapId;
+    }
+    if (a.tileX != b.tileX)
+    {
+        return a.tileX < b.tileX;
+    }
+    return a.tileY < b.tileY;
+}
+
+DirFileWriter::DirFileWriter() : m_file(NULL), m_offset(0), m_failed(false)
+{
+}
+
+DirFileWriter::~DirFileWriter()
+{
+    close();
+}
+
+bool DirFileWriter::open(char const* filename)
+{
+    m_file = fopen(filename, "ab");
+    if (!m_file)
+    {
+        printf("Can't open dirfile!'%s'\n", filename);
+        return false;
+    }
+
+    // appended records are indexed from the current end of the file
+    fseek(m_file, 0, SEEK_END);
+    m_offset = uint64(ftell(m_file));
+    m_filename = filename;
+    m_buffer.reserve(DIR_WRITE_BUFFER_SIZE);
+    m_index.clear();
+    m_failed = false;
+    return true;
+}
+
+bool DirFileWriter::write(uint32 mapId, DirFileBuffer const& records)
+{
+    if (!m_file || records.empty())
+    {
+        return m_file != NULL;
+    }
+
+    std::vector<DirFileBuffer::Segment> const& segments = records.getSegments();
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        size_t end = i + 1 < segments.size() ? segments[i + 1].offset : records.getSize();
+        if (end == segments[i].offset)
+        {
+            continue;
+        }
+
+        dir_indexEntry entry;
+        entry.mapId = mapId;
+        entry.tileX = segments[i].tileX;
+        entry.tileY = segments[i].tileY;
+        entry.size = uint32(end - segments[i].offset);
+        entry.offset = m_offset + segments[i].offset;
+        m_index.push_back(entry);
+    }
+
+    if (m_buffer.size() + records.getSize() > DIR_WRITE_BUFFER_SIZE && !flush())
+    {
+        return false;
+    }
+
+    if (records.getSize() >= DIR_WRITE_BUFFER_SIZE)
+    {
+        // large enough to go out on its own
+        if (fwrite(records.getData(), records.getSize(), 1, m_file) != 1)
+        {
+            printf("Can't write to dirfile '%s'\n", m_filename.c_str());
+            m_failed = true;
+            return false;
+        }
+    }
+    else
+    {
+        m_buffer.insert(m_buffer.end(), records.getData(), records.getData() + records.getSize());
+    }
+
+    m_offset += records.getSize();
+    return true;
+}
+
+bool DirFileWriter::flush()
+{
+    if (m_buffer.empty())
+    {
+        return true;
+    }
+
+    bool written = fwrite(&m_buffer[0], m_buffer.size(), 1, m_file) == 1;
+    m_buffer.clear();
+    if (!written)
+    {
+        printf("Can't write to dirfile '%s'\n", m_filename.c_str());
+        m_failed = true;
+    }
+    return written;
+}
+
+bool DirFileWriter::close()
+{
+    if (!m_file)
+    {
+        return false;
+    }
+
+    bool ok = flush() && !m_failed;
+    ok = fclose(m_file) == 0 && ok;
+    m_file = NULL;
+
+    // a partial dir_bin gets no index, readers fall back to scanning it
+    if (ok)
+    {
+        ok = writeIndex();
+    }
+    return ok;
+}
+
+bool DirFileWriter::writeIndex()
+{
+    std::string indexName = m_filename + ".idx";
+    FILE* output = fopen(indexName.c_str(), "wb");
+    if (!output)
+    {
+        printf("Can't create the index '%s'\n", indexName.c_str());
+        return false;
+    }
+
+    std::stable_sort(m_index.begin(), m_index.end(), DirIndexEntryLess);
+
+    dir_indexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(&header.indexMagic, DIR_INDEX_MAGIC, 4);
+    header.indexVersion = DIR_INDEX_VERSION;
+    header.dirFileSize = m_offset;
+    header.entryCount = uint32(m_index.size());
+
+    bool ok = fwrite(&header, sizeof(header), 1, output) == 1;
+    if (ok && !m_index.empty())
+    {
+        ok = fwrite(&m_index[0], sizeof(dir_indexEntry), m_index.size(), output) == m_index.size();
+    }
+    ok = fclose(output) == 0 && ok;
+
+    if (!ok)
+    {
+        printf("Can't write the index '%s'\n", indexName.c_str());
+        remove(indexName.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,230 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef DIRFILE_H
+#define DIRFILE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <ml/loadlib.h>
+
+// Layout of Buildings/dir_bin.idx, written next to dir_bin so a reader can
+// seek to the placements of one tile instead of scanning the whole file:
+//   dir_indexHeader
+//   dir_indexEntry entries[entryCount]      sorted by map, tileX, tileY
+// The global WMO placements of a map are listed as tile 65,65, like in the
+// records themselves. dir_bin itself keeps its record format.
+
+#define DIR_INDEX_MAGIC         "DIRI"
+#define DIR_INDEX_VERSION       1
+
+/**
+ * @brief
+ *
+ */
+struct dir_indexHeader
+{
+    uint32 indexMagic;          /**< TODO */
+    uint32 indexVersion;        /**< TODO */
+    uint64 dirFileSize;         /**< size of dir_bin, to detect a stale index */
+    uint32 entryCount;          /**< TODO */
+    uint32 padding;             /**< TODO */
+};
+
+/**
+ * @brief Placements of one tile, a contiguous range of dir_bin
+ *
+ */
+struct dir_indexEntry
+{
+    uint32 mapId;               /**< TODO */
+    uint32 tileX;               /**< TODO */
+    uint32 tileY;               /**< TODO */
+    uint32 size;                /**< TODO */
+    uint64 offset;              /**< TODO */
+};
+
+/**
+ * @brief Model placements of one WDT or one row of ADTs, in the dir_bin
+ *        record format
+ *
+ * Each worker fills its own buffer, the buffers are written to dir_bin in
+ * map and tile order afterwards so the file does not depend on the order the
+ * workers finish in.
+ */
+class DirFileBuffer
+{
+    public:
+        /**
+         * @brief Where the records of a tile start in the buffer
+         *
+         */
+        struct Segment
+        {
+            uint32 tileX;       /**< TODO */
+            uint32 tileY;       /**< TODO */
+            size_t offset;      /**< TODO */
+        };
+
+        /**
+         * @brief Records appended from now on belong to this tile
+         *
+         * @param tileX
+         * @param tileY
+         */
+        void beginTile(uint32 tileX, uint32 tileY)
+        {
+            Segment segment;
+            segment.tileX = tileX;
+            segment.tileY = tileY;
+            segment.offset = m_data.size();
+            m_segments.push_back(segment);
+        }
+
+        /**
+         * @brief
+         *
+         * @param data
+         * @param size
+         */
+        void append(void const* data, size_t size)
+        {
+            char const* bytes = (char const*)data;
+            m_data.insert(m_data.end(), bytes, bytes + size);
+        }
+
+        /**
+         * @brief
+         *
+         * @return bool
+         */
+        bool empty() const { return m_data.empty(); }
+
+        /**
+         * @brief
+         *
+         * @return const char
+         */
+        char const* getData() const { return m_data.empty() ? NULL : &m_data[0]; }
+
+        /**
+         * @brief
+         *
+         * @return size_t
+         */
+        size_t getSize() const { return m_data.size(); }
+
+        /**
+         * @brief
+         *
+         * @return const std::vector<Segment>
+         */
+        std::vector<Segment> const& getSegments() const { return m_segments; }
+
+        /**
+         * @brief Releases the memory of the buffer
+         *
+         */
+        void clear()
+        {
+            std::vector<char>().swap(m_data);
+            std::vector<Segment>().swap(m_segments);
+        }
+
+    private:
+        std::vector<char> m_data;           /**< TODO */
+        std::vector<Segment> m_segments;    /**< TODO */
+};
+
+/**
+ * @brief Writes dir_bin and its index
+ *
+ * The file stays open while the placements of all maps are added. Small
+ * buffers are collected and written in large sequential writes.
+ */
+class DirFileWriter
+{
+    public:
+        /**
+         * @brief
+         *
+         */
+        DirFileWriter();
+        /**
+         * @brief
+         *
+         */
+        ~DirFileWriter();
+
+        /**
+         * @brief
+         *
+         * @param filename
+         * @return bool
+         */
+        bool open(char const* filename);
+
+        /**
+         * @brief Appends the placements of a map, in the order of the calls
+         *
+         * @param mapId
+         * @param records
+         * @return bool false if the write failed
+         */
+        bool write(uint32 mapId, DirFileBuffer const& records);
+
+        /**
+         * @brief Flushes dir_bin and writes the index next to it
+         *
+         * @return bool
+         */
+        bool close();
+
+    private:
+        DirFileWriter(DirFileWriter const&);
+        DirFileWriter& operator=(DirFileWriter const&);
+
+        /**
+         * @brief
+         *
+         * @return bool
+         */
+        bool flush();
+        /**
+         * @brief Writes <filename>.idx from the collected tile ranges
+         *
+         * @return bool
+         */
+        bool writeIndex();
+
+        FILE* m_file;                           /**< TODO */
+        std::string m_filename;                 /**< TODO */
+        std::vector<char> m_buffer;             /**< records not written yet */
+        uint64 m_offset;                        /**< size of dir_bin including m_buffer */
+        std::vector<dir_indexEntry> m_index;    /**< TODO */
+        bool m_failed;                          /**< TODO */
+};
+
+#endif
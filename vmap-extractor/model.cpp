@@ -30,7 +30,9 @@
 #include "model.h"
 #include "wmo.h"
 #include "dbcfile.h"
+#include "DBCTable.h"
 #include "vmapexport.h"
+#include "modelregistry.h"
 #include <ExtractorCommon.h>
 
 Model::Model(std::string& filename) : filename(filename), vertices(0), indices(0)
@@ -39,7 +41,7 @@ Model::Model(std::string& filename) : filename(filename), vertices(0), indices(0
 
 bool Model::open(StringSet& failedPaths, int iCoreNumber)
 {
-    MPQFile f(filename.c_str());
+    ConcurrentMPQFile f(filename.c_str());
 
     ok = !f.isEof();
 
@@ -110,6 +112,19 @@ bool Model::open(StringSet& failedPaths, int iCoreNumber)
     return true;
 }
 
+uint32 Model::getVertexCount(int iCoreNumber) const
+{
+    if (iCoreNumber == CLIENT_CLASSIC || iCoreNumber == CLIENT_TBC)
+    {
+        return headerClassicTBC.nBoundingVertices;
+    }
+    if (iCoreNumber == CLIENT_WOTLK || iCoreNumber == CLIENT_CATA)
+    {
+        return headerOthers.nBoundingVertices;
+    }
+    return 0;
+}
+
 bool Model::ConvertToVMAPModel(std::string& outfilename,int iCoreNumber, const void *szRawVMAPMagic)
 {
     int N[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -121,15 +136,7 @@ bool Model::ConvertToVMAPModel(std::string& outfilename,int iCoreNumber, const v
     }
 
     fwrite(szRawVMAPMagic, 8, 1, output);
-    uint32 nVertices = 0;
-    if (iCoreNumber == CLIENT_CLASSIC || iCoreNumber == CLIENT_TBC)
-    {
-        nVertices = headerClassicTBC.nBoundingVertices;
-    }
-    if (iCoreNumber == CLIENT_WOTLK || iCoreNumber == CLIENT_CATA)
-    {
-        nVertices = headerOthers.nBoundingVertices;
-    }
+    uint32 nVertices = getVertexCount(iCoreNumber);
 
     fwrite(&nVertices, sizeof(int), 1, output);
     uint32 nofgroups = 1;
@@ -179,7 +186,7 @@ bool Model::ConvertToVMAPModel(std::string& outfilename,int iCoreNumber, const v
 
 
 
-ModelInstance::ModelInstance(MPQFile& f, string& ModelInstName, uint32 mapID, uint32 tileX, uint32 tileY, FILE* pDirfile, int coreNumber)
+ModelInstance::ModelInstance(ConcurrentMPQFile& f, string& ModelInstName, uint32 mapID, uint32 tileX, uint32 tileY, DirFileBuffer& dirData, int coreNumber)
 {
     float ff[3];
     f.read(&id, 4);
@@ -200,23 +207,8 @@ ModelInstance::ModelInstance(MPQFile& f, string& ModelInstName, uint32 mapID, ui
         sc = scaleZeroOnly / 1024.0f; // scale factor - divide by 1024. why not just use a float?
     }
 
-    char tempname[512];
-    sprintf(tempname, "%s/%s", szWorkDirWmo, ModelInstName.c_str());
-    FILE* input;
-    input = fopen(tempname, "r+b");
-
-    if (!input)
-    {
-        //printf("ModelInstance::ModelInstance couldn't open %s\n", tempname);
-        return;
-    }
-
-    fseek(input, 8, SEEK_SET); // get the correct no of vertices
-    int nVertices;
-    size_t file_read = fread(&nVertices, sizeof(int), 1, input);
-    fclose(input);
-
-    if (nVertices == 0 || file_read <= 0)
+    uint32 nVertices;
+    if (!ModelRegistry::getVertexCount(ModelInstName, nVertices) || nVertices == 0)
     {
         return;
     }
@@ -228,18 +220,18 @@ ModelInstance::ModelInstance(MPQFile& f, string& ModelInstName, uint32 mapID, ui
         flags |= MOD_WORLDSPAWN;
     }
     //write mapID, tileX, tileY, Flags, ID, Pos, Rot, Scale, name
-    fwrite(&mapID, sizeof(uint32), 1, pDirfile);
-    fwrite(&tileX, sizeof(uint32), 1, pDirfile);
-    fwrite(&tileY, sizeof(uint32), 1, pDirfile);
-    fwrite(&flags, sizeof(uint32), 1, pDirfile);
-    fwrite(&adtId, sizeof(uint16), 1, pDirfile);
-    fwrite(&id, sizeof(uint32), 1, pDirfile);
-    fwrite(&pos, sizeof(float), 3, pDirfile);
-    fwrite(&rot, sizeof(float), 3, pDirfile);
-    fwrite(&sc, sizeof(float), 1, pDirfile);
+    dirData.append(&mapID, sizeof(uint32));
+    dirData.append(&tileX, sizeof(uint32));
+    dirData.append(&tileY, sizeof(uint32));
+    dirData.append(&flags, sizeof(uint32));
+    dirData.append(&adtId, sizeof(uint16));
+    dirData.append(&id, sizeof(uint32));
+    dirData.append(&pos, sizeof(float) * 3);
+    dirData.append(&rot, sizeof(float) * 3);
+    dirData.append(&sc, sizeof(float));
     uint32 nlen = ModelInstName.length();
-    fwrite(&nlen, sizeof(uint32), 1, pDirfile);
-    fwrite(ModelInstName.c_str(), sizeof(char), nlen, pDirfile);
+    dirData.append(&nlen, sizeof(uint32));
+    dirData.append(ModelInstName.c_str(), nlen);
 
 }
 
@@ -262,7 +254,17 @@ bool ExtractSingleModel(std::string& origPath, std::string& fixedName, StringSet
     output += "/";
     output += fixedName;
 
-    if (FileExists(output.c_str()))
+    ModelStatus status;
+    if (!ModelRegistry::claim(fixedName, status))
+    {
+        if (status == MODEL_MISSING)
+        {
+            failedPaths.insert(origPath);
+        }
+        return status == MODEL_EXTRACTED;
+    }
+
+    if (ModelRegistry::finishExisting(fixedName))
     {
         return true;
     }
@@ -270,10 +272,13 @@ bool ExtractSingleModel(std::string& origPath, std::string& fixedName, StringSet
     Model mdl(origPath);                                    // Possible changed fname
     if (!mdl.open(failedPaths, iCoreNumber))
     {
+        ModelRegistry::finish(fixedName, mdl.ok ? MODEL_SKIPPED : MODEL_MISSING, 0);
         return false;
     }
 
-    return mdl.ConvertToVMAPModel(output, iCoreNumber, szRawVMAPMagic);
+    bool result = mdl.ConvertToVMAPModel(output, iCoreNumber, szRawVMAPMagic);
+    ModelRegistry::finish(fixedName, result ? MODEL_EXTRACTED : MODEL_FAILED, mdl.getVertexCount(iCoreNumber));
+    return result;
 }
 
 void ExtractGameobjectModels(int iCoreNumber, const void *szRawVMAPMagic)
@@ -281,7 +286,8 @@ void ExtractGameobjectModels(int iCoreNumber, const void *szRawVMAPMagic)
     printf("\n");
     printf("Extracting GameObject models...\n");
     DBCFile dbc("DBFilesClient\\GameObjectDisplayInfo.dbc");
-    if (!dbc.open())
+    DBCTable<GameObjectDisplayInfoDBC> table(dbc);
+    if (!dbc.open() || !table.open())
     {
         printf("Fatal error: Invalid GameObjectDisplayInfo.dbc file format!\n");
         exit(1);
@@ -294,9 +300,10 @@ void ExtractGameobjectModels(int iCoreNumber, const void *szRawVMAPMagic)
 
     FILE* model_list = fopen((basepath + "temp_gameobject_models").c_str(), "wb");
 
-    for (DBCFile::Iterator it = dbc.begin(); it != dbc.end(); ++it)
+    for (size_t i = 0; i < table.size(); ++i)
     {
-        path = it->getString(1);
+        DBCTable<GameObjectDisplayInfoDBC>::Row row = table[i];
+        path = row.getString<GameObjectDisplayInfoDBC::ModelName>();
 
         if (path.length() < 4)
         {
@@ -322,9 +329,9 @@ void ExtractGameobjectModels(int iCoreNumber, const void *szRawVMAPMagic)
             result = ExtractSingleModel(path, name, failedPaths, iCoreNumber, szRawVMAPMagic);
         }
 
-        if (result && FileExists((basepath + name).c_str()))
+        if (result && ModelRegistry::isExtracted(name))
         {
-            uint32 displayId = it->getUInt(0);
+            uint32 displayId = row.getUInt<GameObjectDisplayInfoDBC::ID>();
             uint32 path_length = name.length();
             fwrite(&displayId, sizeof(uint32), 1, model_list);
             fwrite(&path_length, sizeof(uint32), 1, model_list);
@@ -59,6 +59,13 @@ class Model
          * @return bool
          */
         bool ConvertToVMAPModel(std::string& outfilename, int iCoreNumber, const void *szRawVMAPMagic);
+        /**
+         * @brief Number of collision vertices of the opened model
+         *
+         * @param iCoreNumber
+         * @return uint32
+         */
+        uint32 getVertexCount(int iCoreNumber) const;
 
         bool ok; /**< TODO */
 
@@ -119,9 +126,9 @@ class ModelInstance
          * @param mapID
          * @param tileX
          * @param tileY
-         * @param pDirfile
+         * @param dirData
          */
-        ModelInstance(MPQFile& f, std::string& ModelInstName, uint32 mapID, uint32 tileX, uint32 tileY, FILE* pDirfile, int iCoreNumber);
+        ModelInstance(ConcurrentMPQFile& f, std::string& ModelInstName, uint32 mapID, uint32 tileX, uint32 tileY, DirFileBuffer& dirData, int iCoreNumber);
 
 };
 
@@ -0,0 +1,156 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#include "modelregistry.h"
+#include "vmapexport.h"
+
+#include <cstdio>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @brief
+ *
+ */
+struct ModelRegistryEntry
+{
+    ModelStatus status; /**< TODO */
+    uint32 nVertices;   /**< TODO */
+};
+
+typedef std::unordered_map<std::string, ModelRegistryEntry> ModelRegistryMap;
+
+static std::mutex registryLock;                 /**< TODO */
+static std::condition_variable registryChanged; /**< signalled when a conversion finishes */
+static ModelRegistryMap registry;               /**< TODO */
+
+/**
+ * @brief Reads the vertex count stored at offset 8 of a converted model
+ *
+ * @param name
+ * @param nVertices 0 if the file is too short
+ * @return bool false if there is no such file
+ */
+static bool ReadVertexCount(std::string const& name, uint32& nVertices)
+{
+    std::string path = std::string(szWorkDirWmo) + "/" + name;
+    FILE* input = fopen(path.c_str(), "rb");
+    if (!input)
+    {
+        return false;
+    }
+
+    if (fseek(input, 8, SEEK_SET) != 0 || fread(&nVertices, sizeof(uint32), 1, input) != 1)
+    {
+        nVertices = 0;
+    }
+    fclose(input);
+    return true;
+}
+
+bool ModelRegistry::claim(std::string const& name, ModelStatus& status)
+{
+    std::unique_lock<std::mutex> lock(registryLock);
+    while (true)
+    {
+        ModelRegistryMap::const_iterator itr = registry.find(name);
+        if (itr == registry.end())
+        {
+            ModelRegistryEntry& entry = registry[name];
+            entry.status = MODEL_IN_PROGRESS;
+            entry.nVertices = 0;
+            return true;
+        }
+
+        if (itr->second.status != MODEL_IN_PROGRESS)
+        {
+            status = itr->second.status;
+            return false;
+        }
+
+        registryChanged.wait(lock);
+    }
+}
+
+void ModelRegistry::finish(std::string const& name, ModelStatus status, uint32 nVertices)
+{
+    std::lock_guard<std::mutex> lock(registryLock);
+    ModelRegistryEntry& entry = registry[name];
+    entry.status = status;
+    entry.nVertices = nVertices;
+    registryChanged.notify_all();
+}
+
+bool ModelRegistry::finishExisting(std::string const& name)
+{
+    uint32 nVertices;
+    if (!ReadVertexCount(name, nVertices))
+    {
+        return false;
+    }
+
+    finish(name, MODEL_EXTRACTED, nVertices);
+    return true;
+}
+
+bool ModelRegistry::getVertexCount(std::string const& name, uint32& nVertices)
+{
+    {
+        std::unique_lock<std::mutex> lock(registryLock);
+        ModelRegistryMap::const_iterator itr = registry.find(name);
+        while (itr != registry.end() && itr->second.status == MODEL_IN_PROGRESS)
+        {
+            registryChanged.wait(lock);
+            itr = registry.find(name);
+        }
+
+        if (itr != registry.end())
+        {
+            nVertices = itr->second.nVertices;
+            return itr->second.status == MODEL_EXTRACTED;
+        }
+    }
+
+    // not converted in this run, the file may be left from an earlier one
+    if (!ReadVertexCount(name, nVertices))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryLock);
+    if (registry.find(name) == registry.end())
+    {
+        ModelRegistryEntry& entry = registry[name];
+        entry.status = MODEL_EXTRACTED;
+        entry.nVertices = nVertices;
+    }
+    return true;
+}
+
+bool ModelRegistry::isExtracted(std::string const& name)
+{
+    uint32 nVertices;
+    return getVertexCount(name, nVertices);
+}
@@ -0,0 +1,101 @@
+/**
+ * MaNGOS is a full featured server for World of Warcraft, supporting
+ * the following clients: 1.12.x, 2.4.3, 3.3.5a, 4.3.4a and 5.4.8
+ *
+ * Copyright (C) 2005-2021 MaNGOS <https://getmangos.eu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * World of Warcraft, and all World of Warcraft or Warcraft art, images,
+ * and lore are copyrighted by Blizzard Entertainment, Inc.
+ */
+
+#ifndef MODELREGISTRY_H
+#define MODELREGISTRY_H
+
+#include <string>
+#include <ml/loadlib.h>
+
+/**
+ * @brief Result of the conversion of a model or WMO
+ *
+ */
+enum ModelStatus
+{
+    MODEL_IN_PROGRESS,      /**< a thread is converting it */
+    MODEL_EXTRACTED,        /**< the converted file is in the buildings directory */
+    MODEL_MISSING,          /**< the source file is not in the archives or incomplete */
+    MODEL_SKIPPED,          /**< nothing to convert, no collision data or a WMO group */
+    MODEL_FAILED            /**< the converted file could not be written */
+};
+
+/**
+ * @brief What is known about the converted models, by uniform name
+ *
+ * Every model is converted by the first thread claiming it, the others wait
+ * for that conversion and take its result. The placements read the vertex
+ * count from here instead of opening the converted file again for each
+ * instance. Models converted by an earlier run are read from the buildings
+ * directory once.
+ */
+class ModelRegistry
+{
+    public:
+        /**
+         * @brief Takes a model for conversion, waits while another thread
+         *        converts it
+         *
+         * @param name uniform name
+         * @param status receives the result if the model was handled before
+         * @return bool true if the caller has to convert it and call finish()
+         */
+        static bool claim(std::string const& name, ModelStatus& status);
+
+        /**
+         * @brief Records the result of a claimed model
+         *
+         * @param name
+         * @param status
+         * @param nVertices
+         */
+        static void finish(std::string const& name, ModelStatus status, uint32 nVertices);
+
+        /**
+         * @brief Finishes a claimed model which is left from an earlier run
+         *
+         * @param name
+         * @return bool false if there is no converted file of that name
+         */
+        static bool finishExisting(std::string const& name);
+
+        /**
+         * @brief
+         *
+         * @param name
+         * @param nVertices
+         * @return bool false if there is no converted file for the model
+         */
+        static bool getVertexCount(std::string const& name, uint32& nVertices);
+
+        /**
+         * @brief
+         *
+         * @param name
+         * @return bool
+         */
+        static bool isExtracted(std::string const& name);
+};
+
+#endif
@@ -45,17 +45,24 @@
 //#pragma comment(lib, "Winmm.lib")
 
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 //From Extractor
 #include "adtfile.h"
 #include "wdtfile.h"
 #include "dbcfile.h"
+#include "DBCTable.h"
 #include "wmo.h"
 #include <ml/mpq.h>
 #include "vmapexport.h"
 #include "Auth/md5.h"
 
 #include "ExtractorCommon.h"
+#include "ConcurrentMPQ.h"
+#include "MPQFileIndex.h"
+#include "MPQFileCache.h"
+#include "TaskScheduler.h"
 
 //------------------------------------------------------------------------------
 // Defines
@@ -79,6 +86,9 @@ char output_path[128] = ".";
 char input_path[1024] = ".";
 bool hasInputPathParam = false;
 bool preciseVectorData = true;
+char const* cacheDir = NULL;
+uint64 cacheSize = 4096;
+int threadCount = 1;
 
 // Constants
 
@@ -114,13 +124,85 @@ void compute_md5(const char* value, char* result)
     result[32]='\0';
 }
 
+/**
+ * @brief String to string map split into shards with a lock each, so the
+ *        workers rarely wait for each other
+ *
+ */
+class ConcurrentNameCache
+{
+    public:
+        /**
+         * @brief
+         *
+         * @param key
+         * @param value
+         * @return bool
+         */
+        bool find(std::string const& key, std::string& value)
+        {
+            Shard& shard = getShard(key);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            std::unordered_map<std::string, std::string>::const_iterator itr = shard.names.find(key);
+            if (itr == shard.names.end())
+            {
+                return false;
+            }
+
+            value = itr->second;
+            return true;
+        }
+
+        /**
+         * @brief
+         *
+         * @param key
+         * @param value
+         */
+        void insert(std::string const& key, std::string const& value)
+        {
+            Shard& shard = getShard(key);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.names[key] = value;
+        }
+
+    private:
+        static const size_t SHARD_COUNT = 16;
+
+        /**
+         * @brief
+         *
+         */
+        struct Shard
+        {
+            std::mutex lock;                                        /**< TODO */
+            std::unordered_map<std::string, std::string> names;     /**< TODO */
+        };
+
+        Shard& getShard(std::string const& key)
+        {
+            return m_shards[std::hash<std::string>()(key) % SHARD_COUNT];
+        }
+
+        Shard m_shards[SHARD_COUNT]; /**< TODO */
+};
+
+static ConcurrentNameCache uniformNames;        /**< lowercased path -> uniform name */
+static ConcurrentNameCache directoryDigests;    /**< directory -> md5 of it */
+
 std::string GetUniformName(std::string& path)
 {
+    // callers rely on the path being lowercased, also when the name is cached
     std::transform(path.begin(),path.end(),path.begin(),::tolower);
 
+    string result;
+    if (uniformNames.find(path, result))
+    {
+        return result;
+    }
+
     string tempPath;
     string file;
-    char digest[33];
 
     std::size_t found = path.find_last_of("/\\");
     if (found != string::npos)
@@ -133,18 +215,22 @@ std::string GetUniformName(std::string& path)
         file = tempPath = path;
     }
 
-    if(!tempPath.empty())
+    if (tempPath.empty())
     {
-        compute_md5(tempPath.c_str(),digest);
+        tempPath = "\\";
     }
-    else
+
+    string digest;
+    if (!directoryDigests.find(tempPath, digest))
     {
-        compute_md5("\\",digest);
+        char md5[33];
+        compute_md5(tempPath.c_str(), md5);
+        digest.assign(md5);
+        directoryDigests.insert(tempPath, digest);
     }
 
-    string result;
-    result = result.assign(digest) + "-" + file;
-
+    result = digest + "-" + file;
+    uniformNames.insert(path, result);
     return result;
 }
 
@@ -169,58 +255,182 @@ void ReadLiquidTypeTableDBC()
 {
     printf(" Reading liquid types from LiquidType.dbc...");
     DBCFile dbc("DBFilesClient\\LiquidType.dbc");
-    if (!dbc.open())
+    DBCTable<LiquidTypeDBC> table(dbc);
+    if (!dbc.open() || !table.open())
     {
         printf("Fatal error: Could not read LiquidType.dbc!\n");
         exit(1);
     }
 
-    size_t LiqType_count = dbc.getRecordCount();
-    size_t LiqType_maxid = dbc.getRecord(LiqType_count - 1).getUInt(0);
+    size_t LiqType_count = table.size();
+    size_t LiqType_maxid = table.getMaxId();
     LiqType = new uint16[LiqType_maxid + 1];
     memset(LiqType, 0xff, (LiqType_maxid + 1) * sizeof(uint16));
 
     for (uint32 x = 0; x < LiqType_count; ++x)
     {
-        LiqType[dbc.getRecord(x).getUInt(0)] = dbc.getRecord(x).getUInt(3);
+        DBCTable<LiquidTypeDBC>::Row row = table[x];
+        LiqType[row.getUInt<LiquidTypeDBC::ID>()] = row.getUInt<LiquidTypeDBC::Type>();
     }
 
     printf(" Success! (%u Liquid Types loaded)\n", (unsigned int)LiqType_count);
 }
 
-void ParseMapFiles(int iCoreNumber)
+/**
+ * @brief Placements of one map, filled by the tasks of the map
+ *
+ */
+struct MapParseResult
+{
+    MapParseResult(TaskScheduler& scheduler) : tasks(scheduler), wdt(NULL), wdtLoaded(false) {}
+    ~MapParseResult() { delete wdt; }
+
+    TaskGroup tasks;                /**< the map task and its ADT row tasks */
+    WDTFile* wdt;                   /**< TODO */
+    bool wdtLoaded;                 /**< TODO */
+    DirFileBuffer wdtData;          /**< global placements of the WDT */
+    DirFileBuffer rowData[64];      /**< placements of the ADTs x,0 to x,63 */
+    StringSet failedPaths[64];      /**< TODO */
+};
+
+/**
+ * @brief Parses the ADTs of one row of a map
+ *
+ */
+class AdtRowParseTask : public Task
+{
+    public:
+        AdtRowParseTask(map_id const& map, int x, int iCoreNumber, MapParseResult* result) :
+            m_map(map), m_x(x), m_coreNumber(iCoreNumber), m_result(result)
+        {
+        }
+
+        void run()
+        {
+            for (int y = 0; y < 64; ++y)
+            {
+                if (ADTFile* ADT = m_result->wdt->GetMap(m_x, y))
+                {
+                    m_result->rowData[m_x].beginTile(m_x, y);
+                    ADT->init(m_map.id, m_x, y, m_result->failedPaths[m_x], m_coreNumber, szRawVMAPMagic, m_result->rowData[m_x]);
+                    delete ADT;
+                }
+            }
+        }
+
+    private:
+        map_id const& m_map;        /**< TODO */
+        int m_x;                    /**< TODO */
+        int m_coreNumber;           /**< TODO */
+        MapParseResult* m_result;   /**< TODO */
+};
+
+/**
+ * @brief Parses the WDT of a map and queues its ADT rows
+ *
+ */
+class MapParseTask : public Task
+{
+    public:
+        MapParseTask(map_id& map, int iCoreNumber, MapParseResult* result) :
+            m_map(map), m_coreNumber(iCoreNumber), m_result(result)
+        {
+        }
+
+        void run()
+        {
+            char fn[512];
+            char id[10];
+            sprintf(id, "%03u", m_map.id);
+            sprintf(fn, "World\\Maps\\%s\\%s.wdt", m_map.name, m_map.name);
+            m_result->wdt = new WDTFile(fn, m_map.name);
+            m_result->wdtData.beginTile(65, 65);
+            if (!m_result->wdt->init(id, m_map.id, m_result->wdtData))
+            {
+                return;
+            }
+
+            m_result->wdtLoaded = true;
+            for (int x = 0; x < 64; ++x)
+            {
+                m_result->tasks.run(new AdtRowParseTask(m_map, x, m_coreNumber, m_result));
+            }
+        }
+
+    private:
+        map_id& m_map;              /**< TODO */
+        int m_coreNumber;           /**< TODO */
+        MapParseResult* m_result;   /**< TODO */
+};
+
+/**
+ * @brief
+ *
+ * @param index of the map in map_ids
+ * @param iCoreNumber
+ * @param scheduler
+ * @return MapParseResult filled once its tasks are done
+ */
+static MapParseResult* QueueMapParse(unsigned int index, int iCoreNumber, TaskScheduler& scheduler)
+{
+    MapParseResult* result = new MapParseResult(scheduler);
+    result->tasks.run(new MapParseTask(map_ids[index], iCoreNumber, result));
+    return result;
+}
+
+void ParseMapFiles(int iCoreNumber, TaskScheduler& scheduler)
 {
-    char fn[512];
-    //char id_filename[64];
-    char id[10];
     StringSet failedPaths;
     printf("\n");
+
+    std::string dirname = std::string(szWorkDirWmo) + "/dir_bin";
+    DirFileWriter dirfile;
+    if (!dirfile.open(dirname.c_str()))
+    {
+        return;
+    }
+
+    // maps are parsed a few at a time ahead of the one written next, so the
+    // placements waiting to be written stay bounded
+    std::vector<MapParseResult*> results(map_count, (MapParseResult*)NULL);
+    unsigned int window = unsigned(scheduler.getThreadCount()) * 2;
+    unsigned int queued = 0;
+    for (; queued < map_count && queued < window; ++queued)
+    {
+        results[queued] = QueueMapParse(queued, iCoreNumber, scheduler);
+    }
+
     for (unsigned int i = 0; i < map_count; ++i)
     {
-        sprintf(id, "%03u", map_ids[i].id);
-        sprintf(fn, "World\\Maps\\%s\\%s.wdt", map_ids[i].name, map_ids[i].name);
-        WDTFile WDT(fn, map_ids[i].name);
-        if (WDT.init(id, map_ids[i].id))
+        MapParseResult* result = results[i];
+        result->tasks.wait();
+
+        if (result->wdtLoaded)
         {
             printf(" Processing Map %u (%s)\n[", map_ids[i].id, map_ids[i].name);
+            dirfile.write(map_ids[i].id, result->wdtData);
             for (int x = 0; x < 64; ++x)
             {
-                for (int y = 0; y < 64; ++y)
-                {
-                    if (ADTFile* ADT = WDT.GetMap(x, y))
-                    {
-                        //sprintf(id_filename,"%02u %02u %03u",x,y,map_ids[i].id);//!!!!!!!!!
-                        ADT->init(map_ids[i].id, x, y, failedPaths, iCoreNumber, szRawVMAPMagic);
-                        delete ADT;
-                    }
-                }
+                dirfile.write(map_ids[i].id, result->rowData[x]);
+                failedPaths.insert(result->failedPaths[x].begin(), result->failedPaths[x].end());
                 printf("#");
-                fflush(stdout);
             }
+            fflush(stdout);
             printf("]\n");
         }
+
+        delete result;
+        results[i] = NULL;
+
+        if (queued < map_count)
+        {
+            results[queued] = QueueMapParse(queued, iCoreNumber, scheduler);
+            ++queued;
+        }
     }
 
+    dirfile.close();
+
     if (!failedPaths.empty())
     {
         printf(" Warning: Some models could not be extracted, see below\n");
@@ -407,6 +617,13 @@ void Usage(char* prg)
     printf("   -d, --data <path>     search path for game client archives\n");
     printf("   -s, --small           extract smaller vmaps by optimizing data. Reduces\n");
     printf("                         size by ~ 500MB\n");
+    printf("   --cache <path>        keep decompressed archive files in path, shared\n");
+    printf("                         with the map extractor, and map them on later\n");
+    printf("                         runs instead of decompressing them again.\n");
+    printf("   --cache-size #        size limit of the cache in MB, the least recently\n");
+    printf("                         used files are removed. Defaults to 4096.\n");
+    printf("   -t, --threads #       number of worker threads extracting models, 0 for\n");
+    printf("                         one per CPU core. Defaults to 1.\n");
     printf("\n");
     printf(" Example:\n");
     printf(" - use data path and create larger vmaps:\n");
@@ -445,6 +662,39 @@ bool processArgv(int argc, char** argv)
                 strcat(input_path, "/");
             }
         }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            param = argv[++i];
+            if (!param)
+            {
+                result = false;
+                break;
+            }
+
+            cacheDir = param;
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0)
+        {
+            param = argv[++i];
+            if (!param || atoi(param) <= 0)
+            {
+                result = false;
+                break;
+            }
+
+            cacheSize = atoi(param);
+        }
+        else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0)
+        {
+            param = argv[++i];
+            if (!param || atoi(param) < 0)
+            {
+                result = false;
+                break;
+            }
+
+            threadCount = atoi(param);
+        }
         else
         {
             result = false;
@@ -516,6 +766,11 @@ int main(int argc, char** argv)
         }
     }
 
+    if (cacheDir && !MPQFileCache::open(cacheDir, cacheSize * 1024 * 1024))
+    {
+        return 1;
+    }
+
     printf(" Beginning work ....\n");
     //xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx
     // Create the working and ouput directories
@@ -532,6 +787,10 @@ int main(int argc, char** argv)
         {
             delete archive;
         }
+        else
+        {
+            ConcurrentMPQ::addArchive(archiveNames[i]);
+        }
     }
 
     if (gOpenArchives.empty())
@@ -539,6 +798,14 @@ int main(int argc, char** argv)
         printf("FATAL ERROR: None MPQ archive found by path '%s'. Use -d option with proper path.\n", input_path);
         return 1;
     }
+    gFileIndex.build();
+
+    TaskScheduler scheduler(threadCount);
+    if (scheduler.getThreadCount() > 1)
+    {
+        printf(" Using %d threads for extraction\n", scheduler.getThreadCount());
+    }
+
     if (iCoreNumber == CLIENT_CLASSIC)
     {
         ReadLiquidTypeTableDBC();
@@ -547,7 +814,7 @@ int main(int argc, char** argv)
     // extract data
     if (success)
     {
-        success = ExtractWmo(iCoreNumber, szRawVMAPMagic);
+        success = ExtractWmo(iCoreNumber, szRawVMAPMagic, scheduler);
     }
 
     // Open map.dbc
@@ -560,18 +827,26 @@ int main(int argc, char** argv)
             printf("FATAL ERROR: Map.dbc not found in data file.\n");
             return 1;
         }
-        map_count = dbc->getRecordCount();
+        DBCTable<MapDBC> table(*dbc);
+        if (!table.open())
+        {
+            delete dbc;
+            printf("FATAL ERROR: Map.dbc has an unexpected format.\n");
+            return 1;
+        }
+        map_count = table.size();
         map_ids = new map_id[map_count];
         for (unsigned int x = 0; x < map_count; ++x)
         {
-            map_ids[x].id = dbc->getRecord(x).getUInt(0);
-            strcpy(map_ids[x].name, dbc->getRecord(x).getString(1));
+            DBCTable<MapDBC>::Row row = table[x];
+            map_ids[x].id = row.getUInt<MapDBC::ID>();
+            strcpy(map_ids[x].name, row.getString<MapDBC::InternalName>());
             printf(" Map %d - %s\n", map_ids[x].id, map_ids[x].name);
         }
 
 
         delete dbc;
-        ParseMapFiles(iCoreNumber);
+        ParseMapFiles(iCoreNumber, scheduler);
         delete [] map_ids;
         //nError = ERROR_SUCCESS;
         // Extract models, listed in DameObjectDisplayInfo.dbc
@@ -598,6 +873,7 @@ int main(int argc, char** argv)
 
     printf("\n");
     printf(" VMAP building complete. No errors.\n");
+    MPQFileCache::printSummary();
 
     return 0;
 }
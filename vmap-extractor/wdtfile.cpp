@@ -31,7 +31,7 @@ WDTFile::WDTFile(char* file_name, char* file_name1): WDT(file_name)
     filename.assign(file_name1);
 }
 
-bool WDTFile::init(char* map_id, unsigned int mapID)
+bool WDTFile::init(char* map_id, unsigned int mapID, DirFileBuffer& dirData)
 {
     if (WDT.isEof())
     {
@@ -42,15 +42,6 @@ bool WDTFile::init(char* map_id, unsigned int mapID)
     char fourcc[5];
     uint32 size;
 
-    std::string dirname = std::string(szWorkDirWmo) + "/dir_bin";
-    FILE* dirfile;
-    dirfile = fopen(dirname.c_str(), "ab");
-    if (!dirfile)
-    {
-        printf("Can't open dirfile!'%s'\n", dirname.c_str());
-        return false;
-    }
-
     while (!WDT.isEof())
     {
         WDT.read(fourcc, 4);
@@ -98,7 +89,7 @@ bool WDTFile::init(char* map_id, unsigned int mapID)
                 {
                     int id;
                     WDT.read(&id, 4);
-                    WMOInstance inst(WDT, gWmoInstansName[id], mapID, 65, 65, dirfile);
+                    WMOInstance inst(WDT, gWmoInstansName[id], mapID, 65, 65, dirData);
                 }
                 delete[] gWmoInstansName;
             }
@@ -106,7 +97,6 @@ bool WDTFile::init(char* map_id, unsigned int mapID)
         WDT.seek((int)nextpos);
     }
 
-    fclose(dirfile);
     return true;
 }
 
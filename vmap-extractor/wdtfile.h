@@ -54,9 +54,10 @@ class WDTFile
          *
          * @param map_id
          * @param mapID
+         * @param dirData receives the global placements of the map
          * @return bool
          */
-        bool init(char* map_id, unsigned int mapID);
+        bool init(char* map_id, unsigned int mapID, DirFileBuffer& dirData);
 
         std::string* gWmoInstansName; /**< TODO */
         int gnWMO, nMaps; /**< TODO */
@@ -71,7 +72,7 @@ class WDTFile
         ADTFile* GetMap(int x, int z);
 
     private:
-        MPQFile WDT; /**< TODO */
+        ConcurrentMPQFile WDT; /**< TODO */
         bool maps[64][64]; /**< TODO */
         std::string filename; /**< TODO */
 };
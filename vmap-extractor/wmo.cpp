@@ -31,12 +31,14 @@
 #include <map>
 #include <fstream>
 #include <ExtractorCommon.h>
+#include "MPQFileIndex.h"
+#include "TaskScheduler.h"
+#include "modelregistry.h"
 #undef min
 #undef max
 
 extern uint16* LiqType;
 extern bool preciseVectorData;
-extern ArchiveSet gOpenArchives;
 
 WMORoot::WMORoot(std::string& filename) : filename(filename)
 {
@@ -44,7 +46,7 @@ WMORoot::WMORoot(std::string& filename) : filename(filename)
 
 bool WMORoot::open()
 {
-    MPQFile f(filename.c_str());
+    ConcurrentMPQFile f(filename.c_str());
     if (f.isEof())
     {
         printf(" No such file %s.\n", filename.c_str());
@@ -150,7 +152,7 @@ WMOGroup::WMOGroup(std::string& filename) : filename(filename),
 
 bool WMOGroup::open()
 {
-    MPQFile f(filename.c_str());
+    ConcurrentMPQFile f(filename.c_str());
     if (f.isEof())
     {
         printf(" No such file.\n");
@@ -549,7 +551,7 @@ WMOGroup::~WMOGroup()
 }
 
 //WmoInstName is in the form MD5/name.wmo
-WMOInstance::WMOInstance(MPQFile& f, std::string& WmoInstName, uint32 mapID, uint32 tileX, uint32 tileY, FILE* pDirfile)
+WMOInstance::WMOInstance(ConcurrentMPQFile& f, std::string& WmoInstName, uint32 mapID, uint32 tileX, uint32 tileY, DirFileBuffer& dirData)
 {
     pos = Vec3D(0, 0, 0);
 
@@ -571,23 +573,14 @@ WMOInstance::WMOInstance(MPQFile& f, std::string& WmoInstName, uint32 mapID, uin
 
     //-----------add_in _dir_file----------------
 
-    char tempname[512];
-    sprintf(tempname, "%s/%s", szWorkDirWmo, WmoInstName.c_str());
-    FILE* input;
-    input = fopen(tempname, "r+b");
-
-    if (!input)
+    uint32 nVertices;
+    if (!ModelRegistry::getVertexCount(WmoInstName, nVertices))
     {
-        printf("WMOInstance::WMOInstance: couldn't open %s\n", tempname);
+        printf("WMOInstance::WMOInstance: couldn't open %s/%s\n", szWorkDirWmo, WmoInstName.c_str());
         return;
     }
 
-    fseek(input, 8, SEEK_SET); // get the correct no of vertices
-    int nVertices;
-    size_t file_read = fread(&nVertices, sizeof(int), 1, input);
-    fclose(input);
-
-    if (nVertices == 0 || file_read <= 0)
+    if (nVertices == 0)
     {
         return;
     }
@@ -611,20 +604,20 @@ WMOInstance::WMOInstance(MPQFile& f, std::string& WmoInstName, uint32 mapID, uin
         flags |= MOD_WORLDSPAWN;
     }
     //write mapID, tileX, tileY, Flags, ID, Pos, Rot, Scale, Bound_lo, Bound_hi, name
-    fwrite(&mapID, sizeof(uint32), 1, pDirfile);
-    fwrite(&tileX, sizeof(uint32), 1, pDirfile);
-    fwrite(&tileY, sizeof(uint32), 1, pDirfile);
-    fwrite(&flags, sizeof(uint32), 1, pDirfile);
-    fwrite(&adtId, sizeof(uint16), 1, pDirfile);
-    fwrite(&id, sizeof(uint32), 1, pDirfile);
-    fwrite(&pos, sizeof(float), 3, pDirfile);
-    fwrite(&rot, sizeof(float), 3, pDirfile);
-    fwrite(&scale, sizeof(float), 1, pDirfile);
-    fwrite(&pos2, sizeof(float), 3, pDirfile);
-    fwrite(&pos3, sizeof(float), 3, pDirfile);
+    dirData.append(&mapID, sizeof(uint32));
+    dirData.append(&tileX, sizeof(uint32));
+    dirData.append(&tileY, sizeof(uint32));
+    dirData.append(&flags, sizeof(uint32));
+    dirData.append(&adtId, sizeof(uint16));
+    dirData.append(&id, sizeof(uint32));
+    dirData.append(&pos, sizeof(float) * 3);
+    dirData.append(&rot, sizeof(float) * 3);
+    dirData.append(&scale, sizeof(float));
+    dirData.append(&pos2, sizeof(float) * 3);
+    dirData.append(&pos3, sizeof(float) * 3);
     uint32 nlen = WmoInstName.length();
-    fwrite(&nlen, sizeof(uint32), 1, pDirfile);
-    fwrite(WmoInstName.c_str(), sizeof(char), nlen, pDirfile);
+    dirData.append(&nlen, sizeof(uint32));
+    dirData.append(WmoInstName.c_str(), nlen);
 
 }
 
@@ -636,7 +629,13 @@ bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAP
 
     sprintf(szLocalFile, "%s/%s", szWorkDirWmo, plain_name.c_str());
 
-    if (FileExists(szLocalFile))
+    ModelStatus status;
+    if (!ModelRegistry::claim(plain_name, status))
+    {
+        return status != MODEL_FAILED;
+    }
+
+    if (ModelRegistry::finishExisting(plain_name))
     {
         return true;
     }
@@ -660,6 +659,7 @@ bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAP
 
     if (p == 3)
     {
+        ModelRegistry::finish(plain_name, MODEL_SKIPPED, 0);
         return true;
     }
 
@@ -670,6 +670,7 @@ bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAP
     if (!froot.open())
     {
         printf("Couldn't open RootWmo!!!\n");
+        ModelRegistry::finish(plain_name, MODEL_MISSING, 0);
         return true;
     }
 
@@ -677,6 +678,7 @@ bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAP
     if (!output)
     {
         printf("Couldn't open %s for writing!\n", szLocalFile);
+        ModelRegistry::finish(plain_name, MODEL_FAILED, 0);
         return false;
     }
 
@@ -715,26 +717,56 @@ bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAP
     {
         remove(szLocalFile);
     }
+    ModelRegistry::finish(plain_name, file_ok ? MODEL_EXTRACTED : MODEL_MISSING, Wmo_nVertices);
     return true;
 }
 
-bool ExtractWmo(int iCoreNumber, const void *szRawVMAPMagic)
+/**
+ * @brief Extracts one root WMO and its groups on a worker
+ *
+ */
+class WmoExtractTask : public Task
 {
-    bool success = true;
-
-    for (ArchiveSet::const_iterator ar_itr = gOpenArchives.begin(); ar_itr != gOpenArchives.end() && success; ++ar_itr)
-    {
-        vector<std::string> filelist;
+    public:
+        /**
+         * @brief
+         *
+         * @param name
+         * @param iCoreNumber
+         * @param szRawVMAPMagic
+         */
+        WmoExtractTask(std::string const& name, int iCoreNumber, const void* szRawVMAPMagic) :
+            m_name(name), m_coreNumber(iCoreNumber), m_magic(szRawVMAPMagic)
+        {
+        }
 
-        (*ar_itr)->GetFileListTo(filelist);
-        for (vector<std::string>::iterator fname = filelist.begin(); fname != filelist.end() && success; ++fname)
+        void run()
         {
-            if (fname->find(".wmo") != string::npos)
-            {
-                ExtractSingleWmo(*fname, iCoreNumber, szRawVMAPMagic);
-            }
+            ExtractSingleWmo(m_name, m_coreNumber, m_magic);
         }
+
+    private:
+        std::string m_name;     /**< TODO */
+        int m_coreNumber;       /**< TODO */
+        const void* m_magic;    /**< TODO */
+};
+
+bool ExtractWmo(int iCoreNumber, const void *szRawVMAPMagic, TaskScheduler& scheduler)
+{
+    bool success = true;
+
+    // every name once, from the archive MPQFile reads it from. Each WMO goes
+    // to its own output file, so the files do not depend on the order the
+    // workers finish them in.
+    MPQFileIndex::EntryList wmoFiles;
+    gFileIndex.findByExtension(".wmo", wmoFiles);
+
+    TaskGroup tasks(scheduler);
+    for (MPQFileIndex::EntryList::const_iterator itr = wmoFiles.begin(); itr != wmoFiles.end(); ++itr)
+    {
+        tasks.run(new WmoExtractTask((*itr)->name, iCoreNumber, szRawVMAPMagic));
     }
+    tasks.wait();
 
     if (success)
     {
@@ -32,8 +32,12 @@
 #include <set>
 #include "vec3d.h"
 #include <ml/mpq.h>
+#include "ConcurrentMPQ.h"
+#include "dirfile.h"
 #include <ml/loadlib.h>
 
+class TaskScheduler;
+
 // MOPY flags
 #define WMO_MATERIAL_NOCAMCOLLIDE    0x01
 #define WMO_MATERIAL_DETAIL          0x02
@@ -197,9 +201,9 @@ class WMOInstance
          * @param mapID
          * @param tileX
          * @param tileY
-         * @param pDirfile
+         * @param dirData
          */
-        WMOInstance(MPQFile& f, std::string& WmoInstName, uint32 mapID, uint32 tileX, uint32 tileY, FILE* pDirfile);
+        WMOInstance(ConcurrentMPQFile& f, std::string& WmoInstName, uint32 mapID, uint32 tileX, uint32 tileY, DirFileBuffer& dirData);
 
         /**
          * @brief
@@ -217,11 +221,13 @@ class WMOInstance
 bool ExtractSingleWmo(std::string& fname, int iCoreNumber, const void *szRawVMAPMagic);
 
 /**
- * @brief
+ * @brief Extracts all root WMOs of the archives, spread over the workers
  *
- * @param
+ * @param iCoreNumber
+ * @param szRawVMAPMagic
+ * @param scheduler
  * @return bool
  */
-bool ExtractWmo(int iCoreNumber, const void *szRawVMAPMagic);
+bool ExtractWmo(int iCoreNumber, const void *szRawVMAPMagic, TaskScheduler& scheduler);
 
 #endif